@@ -0,0 +1,386 @@
+// vim: textwidth=100
+#include "cachelineperf.h"
+#include "tests.h"
+#include "test_runner.h"
+#include "sample_dump.h"
+#include "tsc.h"
+#include "common.h"
+
+#include <algorithm>
+#include <iterator>
+#include <sstream>
+#include <stdexcept>
+#include <system_error>
+
+#include <sched.h>
+
+struct measurement::details {
+    unsigned m_mode = 0;
+    std::vector<unsigned short> m_cpuids;
+    test_case_iface::config m_config;
+    runner_options m_options;
+    bool m_processes = false;
+    // where the report and the log are printed to, they are captured into the result if null
+    std::ostream* m_out = nullptr;
+    std::ostream* m_err = nullptr;
+    std::string m_dump_path;
+    // the two-sided test case of the mode kept between measurements to reuse its sample buffers
+    std::shared_ptr<test_case_iface> m_test_case;
+};
+
+namespace {
+
+const char* const g_mode_names[] = {
+    "one side test",
+    "one side test, storing and reading TSC in one asm block",
+    "ping pong test",
+    "one side test, relaxed for the branch predictor",
+    "MPMC bounded array queue test",
+    "MPMC linked list queue test",
+    "seqlock test",
+    "broadcast ring test",
+    "global atomic counter test",
+    "per-core sharded counter test",
+    "per-NUMA-node sharded counter test",
+    "memory ordering cost matrix",
+    "store buffer drain and fence latency test",
+    "wake from idle test",
+    "in-process latency probe test"
+};
+
+// a test case of the mode if it's a two-sided one
+std::unique_ptr<test_case_iface> make_test_case(unsigned mode) {
+    switch (mode) {
+    case 0:
+        return std::make_unique<one_side_test>();
+    case 1:
+        return std::make_unique<one_side_asm_test>();
+    case 2:
+        return std::make_unique<ping_pong_test>();
+    case 3:
+        return std::make_unique<one_side_asm_relax_branch_pred_test>();
+    case 11:
+        return std::make_unique<memory_ordering_test>();
+    case 12:
+        return std::make_unique<store_fence_test>();
+    case 13:
+        return std::make_unique<wake_from_idle_test>();
+    case 14:
+        return std::make_unique<latency_probe_test>();
+    default:
+        return nullptr;
+    }
+}
+
+// a test case of the mode if it has an arbitrary number of workers
+std::unique_ptr<multi_test_case_iface> make_multi_test_case(unsigned mode) {
+    switch (mode) {
+    case 4:
+        return std::make_unique<mpmc_array_queue_test>();
+    case 5:
+        return std::make_unique<mpmc_list_queue_test>();
+    case 6:
+        return std::make_unique<seqlock_test>();
+    case 7:
+        return std::make_unique<broadcast_ring_test>();
+    case 8:
+        return std::make_unique<global_counter_test>();
+    case 9:
+        return std::make_unique<per_core_counter_test>();
+    case 10:
+        return std::make_unique<per_numa_node_counter_test>();
+    default:
+        return nullptr;
+    }
+}
+
+page_size to_page_size(std::size_t bytes) {
+    switch (bytes) {
+    case 0:
+        return page_size::normal;
+    case std::size_t{1} << 21:
+        return page_size::huge_2m;
+    case std::size_t{1} << 30:
+        return page_size::huge_1g;
+    default:
+        throw std::invalid_argument{"pages of " + std::to_string(bytes) + " bytes aren't supported"};
+    }
+}
+
+void to_mapping_options(const memory_placement& placement, mapping_options& opts) {
+    opts.m_numa_node = placement.m_numa_node;
+    opts.m_page_size = to_page_size(placement.m_page_size);
+    opts.m_lock = placement.m_lock;
+}
+
+void check_workers(std::uint16_t count) {
+    if (count == 0)
+        throw std::invalid_argument{"a test needs at least one worker of every kind"};
+}
+
+double sorted_quantile(const std::vector<double>& sorted, double q) noexcept {
+    return sorted[std::min(sorted.size() - 1, static_cast<std::size_t>(static_cast<double>(sorted.size()) * q))];
+}
+
+void set_samples(measurement_result& res, std::vector<double> samples) {
+    if (! samples.empty()) {
+        auto sorted = samples;
+        std::sort(sorted.begin(), sorted.end());
+        res.m_median = sorted_quantile(sorted, 0.5);
+        res.m_p90 = sorted_quantile(sorted, 0.9);
+        res.m_p99 = sorted_quantile(sorted, 0.99);
+        res.m_p999 = sorted_quantile(sorted, 0.999);
+    }
+    res.m_samples = std::move(samples);
+}
+
+// workers run as processes exchange data and samples through shared mappings
+test_case_iface::config test_config(test_case_iface::config cfg, bool processes) {
+    cfg.m_memory.m_shared = processes;
+    cfg.m_samples_memory.m_shared = processes;
+    return cfg;
+}
+
+} // ns anonymous
+
+std::size_t modes_count() noexcept {
+    return std::size(g_mode_names);
+}
+
+const char* mode_name(unsigned mode) noexcept {
+    return mode < std::size(g_mode_names) ? g_mode_names[mode] : nullptr;
+}
+
+bool mode_is_two_sided(unsigned mode) noexcept {
+    return mode < modes_count() && ! make_multi_test_case(mode);
+}
+
+bool mode_provides_samples(unsigned mode) {
+    if (mode >= modes_count())
+        return false;
+    if (! mode_is_two_sided(mode))
+        return true;
+    // a two-sided test case tells whether it provides samples only once it's configured
+    auto test_case = make_test_case(mode);
+    test_case->set_config({});
+    return test_case->collect_samples() != nullptr;
+}
+
+double core_to_tsc_ratio(unsigned short cpuid) {
+    return test_runner::measure_core_to_tsc_ratio(cpuid);
+}
+
+measurement::measurement() : m_details{std::make_unique<details>()} {}
+
+measurement::measurement(const measurement& other) : m_details{std::make_unique<details>(*other.m_details)} {
+    m_details->m_test_case.reset();
+}
+
+measurement& measurement::operator=(const measurement& other) {
+    if (this != &other) {
+        *m_details = *other.m_details;
+        m_details->m_test_case.reset();
+    }
+    return *this;
+}
+
+measurement::~measurement() = default;
+
+void measurement::set_mode(unsigned mode) {
+    if (mode != m_details->m_mode)
+        m_details->m_test_case.reset();
+    m_details->m_mode = mode;
+}
+
+void measurement::set_cpuids(std::vector<unsigned short> cpuids) {
+    m_details->m_cpuids = std::move(cpuids);
+}
+
+void measurement::set_attempts(std::uint32_t attempts) {
+    m_details->m_config.m_attempts_count = attempts;
+}
+
+void measurement::set_producers(std::uint16_t count) {
+    check_workers(count);
+    m_details->m_config.m_producers = count;
+}
+
+void measurement::set_consumers(std::uint16_t count) {
+    check_workers(count);
+    m_details->m_config.m_consumers = count;
+}
+
+void measurement::set_readers(std::uint16_t count) {
+    check_workers(count);
+    m_details->m_config.m_readers = count;
+}
+
+void measurement::set_incrementers(std::uint16_t count) {
+    check_workers(count);
+    m_details->m_config.m_incrementers = count;
+}
+
+void measurement::set_record_lines(std::uint16_t lines) {
+    if (lines == 0)
+        throw std::invalid_argument{"a record needs at least one cache line"};
+    m_details->m_config.m_record_lines = lines;
+}
+
+void measurement::set_data_memory(const memory_placement& placement, std::size_t slot_size) {
+    if (slot_size < g_cache_line_size || (slot_size & (slot_size - 1)))
+        throw std::invalid_argument{"slot size must be a power of two not less than the cache line size"};
+    auto& memory = m_details->m_config.m_memory;
+    to_mapping_options(placement, memory);
+    memory.m_slot_size = slot_size;
+}
+
+void measurement::set_samples_memory(const memory_placement& placement) {
+    to_mapping_options(placement, m_details->m_config.m_samples_memory);
+}
+
+void measurement::set_jitter_threshold(std::uint64_t cycles) {
+    m_details->m_config.m_jitter_threshold = cycles;
+}
+
+void measurement::set_idle(std::uint32_t period_us, idle how) {
+    m_details->m_config.m_idle_us = period_us;
+    m_details->m_config.m_idle_kind = how == idle::pause ? idle_kind::pause : idle_kind::sleep;
+}
+
+void measurement::set_processes(bool processes) {
+    m_details->m_processes = processes;
+}
+
+void measurement::set_perf_counters(bool enabled, std::vector<std::uint64_t> raw_events) {
+    m_details->m_options.m_perf_counters = enabled;
+    m_details->m_options.m_raw_perf_events = std::move(raw_events);
+}
+
+void measurement::set_scheduling(int policy, int priority) {
+    const auto min_priority = sched_get_priority_min(policy);
+    const auto max_priority = sched_get_priority_max(policy);
+    if (min_priority < 0 || priority < min_priority || priority > max_priority)
+        throw std::invalid_argument{"scheduling priority must be in range [" + std::to_string(min_priority) + ", "
+            + std::to_string(max_priority) + "]"};
+    m_details->m_options.m_sched_policy = policy;
+    m_details->m_options.m_sched_priority = priority;
+}
+
+void measurement::set_lock_all(bool lock) {
+    m_details->m_options.m_lock_all = lock;
+}
+
+void measurement::set_min_timer_slack(bool min) {
+    m_details->m_options.m_min_timer_slack = min;
+}
+
+void measurement::set_adaptive_ci(double share) {
+    if (! (share >= 0.0))
+        throw std::invalid_argument{"confidence interval share can't be negative"};
+    m_details->m_options.m_adaptive_ci = share;
+}
+
+void measurement::set_timeline(std::chrono::seconds bucket) {
+    m_details->m_options.m_timeline_bucket = bucket;
+}
+
+void measurement::set_time_budget(std::chrono::seconds budget) {
+    m_details->m_options.m_time_budget = budget;
+}
+
+void measurement::set_quiet(bool quiet) {
+    m_details->m_options.m_quiet = quiet;
+}
+
+void measurement::set_output(std::ostream* out, std::ostream* err) {
+    m_details->m_out = out;
+    m_details->m_err = err;
+}
+
+void measurement::set_dump_path(std::string path) {
+    m_details->m_dump_path = std::move(path);
+}
+
+std::size_t workers_count(const measurement& request) {
+    const auto& details = *request.m_details;
+    if (details.m_mode >= modes_count())
+        throw std::invalid_argument{"unknown test mode " + std::to_string(details.m_mode)};
+    auto multi_test_case = make_multi_test_case(details.m_mode);
+    if (! multi_test_case)
+        return 2;
+    multi_test_case->set_config(test_config(details.m_config, details.m_processes));
+    return multi_test_case->workers_count();
+}
+
+measurement_result measure(const measurement& request) {
+    auto& details = *request.m_details;
+    if (details.m_mode >= modes_count())
+        throw std::invalid_argument{"unknown test mode " + std::to_string(details.m_mode)};
+    if (details.m_mode != 0 && details.m_config.m_jitter_threshold)
+        throw std::invalid_argument{"interruptions are detected in mode 0 only"};
+
+    measurement_result res;
+    std::ostringstream report;
+    std::ostringstream log;
+    auto opts = details.m_options;
+    opts.m_out = details.m_out ? details.m_out : &report;
+    opts.m_err = details.m_err ? details.m_err : &log;
+
+    if (auto multi_test_case = make_multi_test_case(details.m_mode)) {
+        if (details.m_processes)
+            throw std::invalid_argument{"separate processes are supported by two-sided tests only"};
+        if (opts.m_adaptive_ci > 0.0 || opts.m_timeline_bucket.count() > 0)
+            throw std::invalid_argument{"repeated runs are supported by two-sided tests only"};
+        if (! details.m_dump_path.empty())
+            throw std::invalid_argument{"samples can be dumped for two-sided tests only"};
+        multi_test_case->set_config(test_config(details.m_config, details.m_processes));
+        if (details.m_cpuids.size() < multi_test_case->workers_count())
+            throw std::invalid_argument{"the test needs " + std::to_string(multi_test_case->workers_count())
+                + " cpu ids but " + std::to_string(details.m_cpuids.size()) + " provided"};
+        std::vector<unsigned short> cpuids{details.m_cpuids.begin(),
+            details.m_cpuids.begin() + static_cast<std::ptrdiff_t>(multi_test_case->workers_count())};
+        res.m_status = test_runner{std::move(cpuids), std::move(opts)}.run(*multi_test_case);
+        if (res.m_status == 0)
+            set_samples(res, multi_test_case->collect_samples());
+    } else {
+        if (details.m_cpuids.size() < 2)
+            throw std::invalid_argument{"the test needs 2 cpu ids but " + std::to_string(details.m_cpuids.size())
+                + " provided"};
+        if (details.m_processes && (opts.m_perf_counters || opts.m_adaptive_ci > 0.0 || opts.m_timeline_bucket.count() > 0))
+            throw std::invalid_argument{"performance counters and repeated runs aren't supported for separate processes"};
+        if (opts.m_adaptive_ci > 0.0 && opts.m_timeline_bucket.count() > 0)
+            throw std::invalid_argument{"a timeline can't be made with adaptive sampling"};
+        // raw samples are kept for the last run only
+        if (! details.m_dump_path.empty() && (opts.m_adaptive_ci > 0.0 || opts.m_timeline_bucket.count() > 0))
+            throw std::invalid_argument{"samples can be dumped for a single run of a test only"};
+
+        if (! details.m_test_case)
+            details.m_test_case = make_test_case(details.m_mode);
+        auto& test_case = *details.m_test_case;
+        test_case.set_config(test_config(details.m_config, details.m_processes));
+        test_runner runner{{details.m_cpuids[0], details.m_cpuids[1]}, std::move(opts)};
+        res.m_status = details.m_processes ? runner.run_processes(test_case) : runner.run(test_case);
+
+        if (res.m_status == 0 && ! details.m_dump_path.empty()) {
+            auto& err = details.m_err ? *details.m_err : log;
+            if (const auto samples = test_case.get_raw_samples(); ! samples.m_first) {
+                err << "mode " << details.m_mode << " doesn't keep raw samples to be dumped" << std::endl;
+                res.m_status = 1;
+            } else
+                try {
+                    write_sample_dump(details.m_dump_path, mode_name(details.m_mode), details.m_cpuids[0],
+                        details.m_cpuids[1], get_cpu_freq_ghz(), samples);
+                } catch (const std::system_error& e) {
+                    err << "unable to dump samples: " << e.what() << std::endl;
+                    res.m_status = 1;
+                }
+        }
+        if (const auto* samples = test_case.collect_samples(); res.m_status == 0 && samples)
+            set_samples(res, *samples);
+    }
+
+    res.m_report = report.str();
+    res.m_log = log.str();
+    res.m_tsc_ghz = get_cpu_freq_ghz();
+    return res;
+}
@@ -0,0 +1,156 @@
+// vim: textwidth=100
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <chrono>
+#include <iosfwd>
+#include <memory>
+#include <optional>
+#include <string>
+#include <vector>
+
+/*
+ * The API of the cachelineperf library to embed measurements into other programs without running
+ * the command line tool: configure a test, pick CPU cores, run it and get the result. Only the
+ * standard library is needed to use it, the tests themselves aren't exposed. The command line
+ * tool is a client of this API too.
+ */
+
+// number of the test modes, modes are numbered from zero
+std::size_t modes_count() noexcept;
+
+// human readable name of the test mode, nullptr if there is no such mode
+const char* mode_name(unsigned mode) noexcept;
+
+// whether the test mode is run by two workers, the rest ones are run by as many workers as they
+// are configured to have
+bool mode_is_two_sided(unsigned mode) noexcept;
+
+// whether measurements of the mode provide samples, so they can be saved, compared or swept;
+// throws std::system_error if the test data can't be allocated to find it out
+bool mode_provides_samples(unsigned mode);
+
+// how many core cycles pass per TSC cycle on the CPU core, i.e. its current frequency relative to
+// the TSC rate; the calling thread is moved there for the measurement and then it's moved back
+double core_to_tsc_ratio(unsigned short cpuid);
+
+// where memory of a test is placed
+struct memory_placement {
+    // NUMA node the memory is bound to, any node if it's negative
+    int m_numa_node = -1;
+    // size of pages in bytes: zero for normal pages, 2 MB or 1 GB for huge pages
+    std::size_t m_page_size = 0;
+    // lock the memory in RAM so it's never swapped out
+    bool m_lock = false;
+};
+
+struct measurement_result {
+    // zero if the test was run successfully
+    int m_status = 0;
+    // the report of the test case including placement of the workers, as the tool prints it
+    std::string m_report;
+    // warnings and errors issued during the run
+    std::string m_log;
+    // latency samples in TSC cycles of all the runs, none if the test case doesn't provide them;
+    // the tests having several workers on a side provide their main latency: of items passed
+    // through a queue, of successful seqlock reads, of ring events and of counter reads
+    std::optional<std::vector<double>> m_samples;
+    // quantiles of the samples in TSC cycles, zero if there are no samples
+    double m_median = 0.0;
+    double m_p90 = 0.0;
+    double m_p99 = 0.0;
+    double m_p999 = 0.0;
+    double m_tsc_ghz = 0.0;
+};
+
+/*
+ * What to measure and how. Setters throw std::invalid_argument if the value can't be used, the
+ * rest of the checks are made by measure().
+ */
+class measurement {
+public:
+    // how the receiver of the wake from idle test spends its idle period
+    enum class idle {
+        // letting the kernel put the core into a C-state
+        sleep,
+        // spinning on the pause instruction keeping the core awake but not busy
+        pause
+    };
+
+    measurement();
+    // the copy doesn't share the test case kept for repeated measurements
+    measurement(const measurement& other);
+    measurement& operator=(const measurement& other);
+    ~measurement();
+
+    // see modes_count()
+    void set_mode(unsigned mode);
+    // CPU cores workers are bound to in order, two-sided tests use the first two ones
+    void set_cpuids(std::vector<unsigned short> cpuids);
+    // number of attempts of the test (default: 1000)
+    void set_attempts(std::uint32_t attempts);
+    // workers of the tests having several workers on a side, at least one (default: 1)
+    void set_producers(std::uint16_t count);
+    void set_consumers(std::uint16_t count);
+    void set_readers(std::uint16_t count);
+    void set_incrementers(std::uint16_t count);
+    // size of the record in the seqlock test in cache lines, at least one (default: 1)
+    void set_record_lines(std::uint16_t lines);
+    // where the data exchanged by workers is placed, every object occupies whole slots of the size
+    // which is a power of two not less than the cache line size
+    void set_data_memory(const memory_placement& placement, std::size_t slot_size = 64);
+    // where samples collected by workers are placed
+    void set_samples_memory(const memory_placement& placement);
+    // samples of mode 0 overlapping interruptions of workers detected as gaps longer than the
+    // threshold in TSC cycles are excluded, zero disables the detection (default)
+    void set_jitter_threshold(std::uint64_t cycles);
+    // idle period of the receiver of the wake from idle test (default: 100us of sleep)
+    void set_idle(std::uint32_t period_us, idle how);
+    // run workers of a two-sided test in separate processes
+    void set_processes(bool processes);
+    // count performance events during the main part of every worker, the raw codes of model
+    // specific events are counted in addition to the generic ones
+    void set_perf_counters(bool enabled, std::vector<std::uint64_t> raw_events = {});
+    // scheduling policy (like SCHED_FIFO) and priority of workers
+    void set_scheduling(int policy, int priority);
+    // lock all the process memory in RAM before starting workers
+    void set_lock_all(bool lock);
+    // make workers' timers as precise as possible
+    void set_min_timer_slack(bool min);
+    // repeat runs of a two-sided test until 95% confidence intervals of the median and the 99th
+    // percentile are narrower than this share of their values, zero disables it (default)
+    void set_adaptive_ci(double share);
+    // repeat runs of a two-sided test for the time budget and report statistics of samples
+    // collected within every bucket of this time, zero disables it (default)
+    void set_timeline(std::chrono::seconds bucket);
+    // when repeated runs stop (default: 60s)
+    void set_time_budget(std::chrono::seconds budget);
+    // don't put the statistics of the test case into the report
+    void set_quiet(bool quiet);
+    // print the report and the log to the streams as the test goes instead of capturing them into
+    // the result, nullptr restores capturing (default)
+    void set_output(std::ostream* out, std::ostream* err);
+    // write raw samples of a two-sided test to the file after a successful run for the offline
+    // reader cacheline_dump_stats, empty disables it (default)
+    void set_dump_path(std::string path);
+
+private:
+    struct details;
+    std::unique_ptr<details> m_details;
+
+    friend std::size_t workers_count(const measurement& request);
+    friend measurement_result measure(const measurement& request);
+};
+
+// number of workers and so CPU cores the configured measurement needs; throws
+// std::invalid_argument for an unknown mode and std::system_error if the test data can't be
+// allocated to find it out
+std::size_t workers_count(const measurement& request);
+
+// Runs the test on the calling thread's behalf and waits for it. Throws std::invalid_argument if
+// the measurement can't be made as requested and std::system_error if the test data can't be
+// allocated; problems of the run itself are reported by the status and the log of the result.
+// Measurements made by the same object one after another reuse memory of the test, but an object
+// can't be measured concurrently.
+measurement_result measure(const measurement& request);
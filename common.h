@@ -0,0 +1,10 @@
+// vim: textwidth=100
+#pragma once
+
+#include <cstddef>
+
+/*
+ * Assume that any operation on caches operates with a data block of one cache line, so it doesn't
+ * matter, whether we invalidate one byte or the whole cache line.
+ */
+inline constexpr std::size_t g_cache_line_size = 64;
@@ -0,0 +1,108 @@
+// vim: textwidth=100
+#include "cpufreq.h"
+
+#include <cerrno>
+#include <cstdint>
+#include <algorithm>
+#include <fstream>
+#include <sstream>
+#include <system_error>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+namespace {
+
+std::string cpufreq_path(unsigned cpuid) {
+    return "/sys/devices/system/cpu/cpu" + std::to_string(cpuid) + "/cpufreq/";
+}
+
+std::string read_line(const std::string& path) {
+    std::ifstream is{path};
+    std::string res;
+    std::getline(is, res);
+    return res;
+}
+
+void write_line(const std::string& path, const std::string& value) {
+    errno = 0;
+    std::ofstream os{path};
+    if (! (os << value << std::endl))
+        throw std::system_error{errno ? errno : EIO, std::generic_category(), "unable to write " + path};
+}
+
+} // ns anonymous
+
+std::vector<unsigned> available_frequencies_khz(unsigned cpuid, unsigned steps) {
+    std::vector<unsigned> res;
+
+    std::istringstream is{read_line(cpufreq_path(cpuid) + "scaling_available_frequencies")};
+    for (unsigned khz; is >> khz; )
+        res.push_back(khz);
+
+    if (res.empty()) {
+        std::istringstream min_is{read_line(cpufreq_path(cpuid) + "cpuinfo_min_freq")};
+        std::istringstream max_is{read_line(cpufreq_path(cpuid) + "cpuinfo_max_freq")};
+        unsigned min, max;
+        if (! (min_is >> min) || ! (max_is >> max) || min > max)
+            return res;
+        for (unsigned step = 0; step < steps; ++step)
+            res.push_back(steps > 1 ? min + static_cast<unsigned>(std::uint64_t{max - min} * step / (steps - 1)) : max);
+    }
+
+    std::sort(res.begin(), res.end());
+    res.erase(std::unique(res.begin(), res.end()), res.end());
+    return res;
+}
+
+frequency_lock::frequency_lock(const std::vector<unsigned short>& cpuids) {
+    for (auto cpuid : cpuids) {
+        if (std::any_of(m_saved.begin(), m_saved.end(), [cpuid](const auto& l){ return l.m_cpuid == cpuid; }))
+            continue;
+        const auto path = cpufreq_path(cpuid);
+        limits saved{cpuid, read_line(path + "scaling_min_freq"), read_line(path + "scaling_max_freq"),
+            read_line(path + "cpuinfo_max_freq")};
+        if (saved.m_min.empty() || saved.m_max.empty() || saved.m_hw_max.empty())
+            throw std::system_error{ENOENT, std::generic_category(),
+                "cpufreq isn't available for cpu " + std::to_string(cpuid)};
+        m_saved.push_back(std::move(saved));
+    }
+}
+
+frequency_lock::~frequency_lock() {
+    for (const auto& saved : m_saved)
+        try {
+            const auto path = cpufreq_path(saved.m_cpuid);
+            write_line(path + "scaling_max_freq", saved.m_hw_max);
+            write_line(path + "scaling_min_freq", saved.m_min);
+            write_line(path + "scaling_max_freq", saved.m_max);
+        } catch (const std::system_error&) {
+            // nothing more can be done
+        }
+}
+
+void frequency_lock::set(unsigned khz) {
+    // the minimum can't exceed the maximum at any moment, so the maximum is raised first
+    for (const auto& saved : m_saved) {
+        const auto path = cpufreq_path(saved.m_cpuid);
+        write_line(path + "scaling_max_freq", saved.m_hw_max);
+        write_line(path + "scaling_min_freq", std::to_string(khz));
+        write_line(path + "scaling_max_freq", std::to_string(khz));
+    }
+}
+
+cpu_latency_lock::cpu_latency_lock() {
+    m_fd = open("/dev/cpu_dma_latency", O_WRONLY);
+    if (m_fd < 0)
+        throw std::system_error{errno, std::generic_category(), "unable to open /dev/cpu_dma_latency"};
+    const std::int32_t latency_us = 0;
+    if (write(m_fd, &latency_us, sizeof(latency_us)) != sizeof(latency_us)) {
+        const auto err = errno;
+        close(m_fd);
+        throw std::system_error{err, std::generic_category(), "unable to write /dev/cpu_dma_latency"};
+    }
+}
+
+cpu_latency_lock::~cpu_latency_lock() {
+    close(m_fd);
+}
@@ -0,0 +1,50 @@
+// vim: textwidth=100
+#pragma once
+
+#include <string>
+#include <vector>
+
+/*
+ * Control of the core frequency via cpufreq sysfs and of C-states via PM QoS. Both need root
+ * privileges, problems are reported by std::system_error.
+ */
+
+// Frequencies in kHz the CPU can be set to in ascending order: the ones listed by the cpufreq
+// driver or, if the driver doesn't list them (e.g. intel_pstate), the given number of steps
+// between the minimal and the maximal frequencies. Empty if cpufreq isn't available.
+std::vector<unsigned> available_frequencies_khz(unsigned cpuid, unsigned steps);
+
+/*
+ * Pins the frequency of CPUs by setting both the minimal and the maximal frequencies of their
+ * cpufreq policies, the original limits are restored on destruction.
+ */
+class frequency_lock {
+    struct limits {
+        unsigned m_cpuid;
+        std::string m_min;
+        std::string m_max;
+        std::string m_hw_max;
+    };
+
+    std::vector<limits> m_saved;
+
+public:
+    explicit frequency_lock(const std::vector<unsigned short>& cpuids);
+    frequency_lock(const frequency_lock&) = delete;
+    ~frequency_lock();
+
+    void set(unsigned khz);
+};
+
+/*
+ * Keeps CPUs out of C-states with exit latency above zero while it's alive, i.e. holds
+ * /dev/cpu_dma_latency open with zero written to it.
+ */
+class cpu_latency_lock {
+    int m_fd;
+
+public:
+    cpu_latency_lock();
+    cpu_latency_lock(const cpu_latency_lock&) = delete;
+    ~cpu_latency_lock();
+};
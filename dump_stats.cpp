@@ -0,0 +1,69 @@
+// vim: textwidth=100
+#include "sample_dump.h"
+#include "stats.h"
+
+#include <cstring>
+#include <iostream>
+#include <stdexcept>
+#include <system_error>
+#include <vector>
+
+/*
+ * Recomputes statistics of raw samples written by cacheline_movement_perf --dump-samples, the same
+ * way they are reported by the test.
+ */
+
+int usage(const char* basename) {
+    if (auto p = std::strrchr(basename, '/'))
+        basename = p + 1;
+
+    std::cout << "Usage: " << basename << " FILE\n"
+        "\n"
+        "Prints statistics of raw samples dumped by cacheline_movement_perf --dump-samples FILE."
+        << std::endl;
+    return 0;
+}
+
+int main(int argc, const char* argv[]) {
+    if (argc != 2 || std::strcmp(argv[1], "--help") == 0)
+        return usage(argv[0]);
+
+    try {
+        const sample_dump dump{argv[1]};
+        const auto& header = dump.header();
+        const auto* data = dump.samples();
+
+        std::vector<double> samples;
+        std::size_t unfinished = 0;
+        samples.reserve(header.m_count);
+        for (std::uint64_t i = 0; i < header.m_count; ++i)
+            if (header.m_kind == sample_dump_header::kind::cycle_pairs) {
+                const auto start = data[2 * i];
+                const auto end = data[2 * i + 1];
+                if (! end)
+                    ++unfinished;
+                else
+                    samples.push_back(static_cast<double>(end) - static_cast<double>(start));
+            } else
+                samples.push_back(static_cast<double>(data[i]) / header.m_handoffs);
+
+        std::cout << "Sample dump:\n"
+            "  test         : " << header.m_test_name << "\n"
+            "  workers cpus : " << header.m_cpuids[0] << ", " << header.m_cpuids[1] << "\n"
+            "  samples      : " << header.m_count << " (" << unfinished << " unfinished)\n"
+            "Test case result:\n";
+        if (samples.empty())
+            std::cout << "  measures     : 0";
+        else
+            print_stats(std::cout, calc_stats(samples), header.m_tsc_ghz);
+        std::cout << std::endl;
+    } catch (const std::system_error& e) {
+        std::cerr << e.what() << std::endl;
+        return 1;
+    } catch (const std::runtime_error& e) {
+        std::cerr << e.what() << std::endl;
+        return 1;
+    }
+
+    return 0;
+}
@@ -0,0 +1,162 @@
+// vim: textwidth=100
+#include "heatmap.h"
+
+#include <cmath>
+#include <algorithm>
+#include <array>
+#include <fstream>
+#include <limits>
+#include <ostream>
+#include <sstream>
+#include <stdexcept>
+
+namespace {
+
+using color = std::array<int, 3>;
+
+// stops of a perceptually uniform color map from low (dark blue) to high (yellow) latencies
+const color g_color_stops[] = {
+    {68, 1, 84}, {59, 82, 139}, {33, 145, 140}, {94, 201, 98}, {253, 231, 37}};
+const color g_no_value_color = {221, 221, 221};
+
+// the range of values the colors are scaled to
+std::pair<double, double> value_range(const latency_matrix& matrix) {
+    double min = std::numeric_limits<double>::infinity();
+    double max = -min;
+    for (auto value : matrix.m_values)
+        if (! std::isnan(value)) {
+            min = std::min(min, value);
+            max = std::max(max, value);
+        }
+    return {min, max};
+}
+
+// a position in the range [0, 1] mapped to a color
+color map_color(double pos) {
+    constexpr auto intervals = std::size(g_color_stops) - 1;
+    pos = std::clamp(pos, 0.0, 1.0) * intervals;
+    const auto idx = std::min(static_cast<std::size_t>(pos), intervals - 1);
+    const auto frac = pos - static_cast<double>(idx);
+
+    color res;
+    for (std::size_t i = 0; i < res.size(); ++i)
+        res[i] = static_cast<int>(std::lround(
+            g_color_stops[idx][i] + (g_color_stops[idx + 1][i] - g_color_stops[idx][i]) * frac));
+    return res;
+}
+
+color value_color(double value, const std::pair<double, double>& range) {
+    if (std::isnan(value))
+        return g_no_value_color;
+    if (range.second <= range.first)
+        return map_color(0.0);
+    return map_color((value - range.first) / (range.second - range.first));
+}
+
+std::ostream& operator<<(std::ostream& os, const color& c) {
+    return os << "rgb(" << c[0] << "," << c[1] << "," << c[2] << ")";
+}
+
+void print_background(std::ostream& os, const color& c) {
+    os << "\x1b[48;2;" << c[0] << ";" << c[1] << ";" << c[2] << "m  \x1b[0m";
+}
+
+} // ns anonymous
+
+void print_heatmap(std::ostream& os, const latency_matrix& matrix) {
+    const auto range = value_range(matrix);
+    const auto size = matrix.m_cpuids.size();
+
+    std::size_t label_width = 1;
+    for (auto cpuid : matrix.m_cpuids)
+        label_width = std::max(label_width, std::to_string(cpuid).size());
+
+    // column labels are written vertically
+    for (std::size_t line = 0; line < label_width; ++line) {
+        os << std::string(label_width + 6, ' ');
+        for (auto cpuid : matrix.m_cpuids) {
+            const auto label = std::to_string(cpuid);
+            const auto pad = label_width - label.size();
+            os << (line < pad ? ' ' : label[line - pad]) << ' ';
+        }
+        os << "\n";
+    }
+
+    for (std::size_t row = 0; row < size; ++row) {
+        const auto label = std::to_string(matrix.m_cpuids[row]);
+        os << "  cpu " << std::string(label_width - label.size(), ' ') << label;
+        for (std::size_t column = 0; column < size; ++column)
+            print_background(os, value_color(matrix.at(row, column), range));
+        os << "\n";
+    }
+
+    if (range.first > range.second)
+        return;
+
+    constexpr int legend_steps = 16;
+    os << "  " << range.first << " ";
+    for (int step = 0; step < legend_steps; ++step)
+        print_background(os, map_color(static_cast<double>(step) / (legend_steps - 1)));
+    os << " " << range.second << " cycles\n";
+}
+
+void save_svg_heatmap(const std::string& path, const latency_matrix& matrix) {
+    constexpr int cell = 10;
+    constexpr int margin = 40;
+    constexpr int legend_height = 40;
+
+    const auto range = value_range(matrix);
+    const auto size = static_cast<int>(matrix.m_cpuids.size());
+    const auto side = margin + size * cell;
+
+    std::ofstream os{path};
+    if (! os)
+        throw std::runtime_error{"unable to open " + path};
+
+    // wide enough for the title
+    os << "<svg xmlns=\"http://www.w3.org/2000/svg\" width=\"" << std::max(side + cell, 420) << "\" height=\""
+        << side + legend_height << "\" font-family=\"monospace\" font-size=\"8\">\n"
+        "<rect width=\"100%\" height=\"100%\" fill=\"white\"/>\n"
+        "<text x=\"2\" y=\"10\" font-size=\"10\">cache line transfer latency, cycles "
+        "(rows: worker 1, columns: worker 2)</text>\n";
+
+    for (int idx = 0; idx < size; ++idx) {
+        const auto pos = margin + idx * cell;
+        os << "<text x=\"" << margin - 2 << "\" y=\"" << pos + cell - 2 << "\" text-anchor=\"end\">"
+            << matrix.m_cpuids[idx] << "</text>\n"
+            "<text transform=\"translate(" << pos + cell - 2 << "," << margin - 2 << ") rotate(-90)\">"
+            << matrix.m_cpuids[idx] << "</text>\n";
+    }
+
+    for (int row = 0; row < size; ++row)
+        for (int column = 0; column < size; ++column) {
+            const auto value = matrix.at(row, column);
+            os << "<rect x=\"" << margin + column * cell << "\" y=\"" << margin + row * cell
+                << "\" width=\"" << cell << "\" height=\"" << cell << "\" fill=\""
+                << value_color(value, range) << "\"><title>cpu " << matrix.m_cpuids[row] << " to cpu "
+                << matrix.m_cpuids[column] << ": ";
+            if (std::isnan(value))
+                os << "no value";
+            else
+                os << value << " cycles";
+            os << "</title></rect>\n";
+        }
+
+    if (range.first <= range.second) {
+        os << "<defs><linearGradient id=\"scale\">";
+        constexpr int stops = std::size(g_color_stops);
+        for (int idx = 0; idx < stops; ++idx)
+            os << "<stop offset=\"" << idx * 100 / (stops - 1) << "%\" stop-color=\""
+                << map_color(static_cast<double>(idx) / (stops - 1)) << "\"/>";
+        os << "</linearGradient></defs>\n"
+            "<rect x=\"" << margin << "\" y=\"" << side + 10 << "\" width=\"" << size * cell
+            << "\" height=\"10\" fill=\"url(#scale)\"/>\n"
+            "<text x=\"" << margin << "\" y=\"" << side + 30 << "\">" << range.first << "</text>\n"
+            "<text x=\"" << side << "\" y=\"" << side + 30 << "\" text-anchor=\"end\">"
+            << range.second << " cycles</text>\n";
+    }
+
+    os << "</svg>\n";
+    if (! os.flush())
+        throw std::runtime_error{"unable to write " + path};
+}
@@ -0,0 +1,28 @@
+// vim: textwidth=100
+#pragma once
+
+#include <cstddef>
+#include <iosfwd>
+#include <string>
+#include <vector>
+
+/*
+ * A matrix of latencies between CPU cores: a row is the CPU of the first worker (the writer) and
+ * a column is the CPU of the second one. A value is NaN if there is no result, e.g. on the
+ * diagonal. CPUs are expected to be ordered by topology (see sort_by_topology()), so packages,
+ * shared caches and SMT siblings show up on heatmaps as blocks.
+ */
+struct latency_matrix {
+    std::vector<unsigned short> m_cpuids;
+    // row-major, in cycles
+    std::vector<double> m_values;
+
+    double at(std::size_t row, std::size_t column) const {
+        return m_values[row * m_cpuids.size() + column];
+    }
+};
+
+// print the heatmap using 24-bit ANSI colors, every cell takes two characters
+void print_heatmap(std::ostream& os, const latency_matrix& matrix);
+// write the heatmap as a self-contained SVG image, throws std::runtime_error on failure
+void save_svg_heatmap(const std::string& path, const latency_matrix& matrix);
@@ -0,0 +1,136 @@
+// vim: textwidth=100
+#pragma once
+
+#include "common.h"
+#include "tsc.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <array>
+#include <atomic>
+
+/*
+ * A probe measuring hand-off latency between two threads of a live process, e.g. between pinned
+ * threads of a service, with the one side technique: the sender stores its TSC into a cache line
+ * now and then, the receiver polls the line and records the difference with its own TSC when the
+ * value changes. The threads call the probe from their own loops, so a sample is the latency as
+ * seen by the application: the line transfer plus the time until the receiver polls it.
+ *
+ * The overhead is bounded by the send period: between messages the sender only reads its TSC and
+ * the receiver reads a line which stays in its cache. Everything is header-only and lock-free, no
+ * threads are started and no memory is allocated.
+ */
+
+/*
+ * Counts of samples in cycles by logarithmic buckets: values below 16 have their own buckets,
+ * larger ones keep 3 significant bits below the leading one, so a bucket is at most 12.5% wide.
+ * There is a single writer, snapshots can be taken concurrently by any thread.
+ */
+class latency_histogram {
+public:
+    static constexpr unsigned s_sub_bits = 3;
+    static constexpr std::size_t s_linear = std::size_t{2} << s_sub_bits;
+    static constexpr std::size_t s_buckets = (64 - s_sub_bits + 1) << s_sub_bits;
+
+    struct snapshot {
+        std::array<std::uint64_t, s_buckets> m_counts{};
+        std::uint64_t m_count = 0;
+
+        // the upper bound of the bucket the quantile falls into, zero if there are no samples
+        std::uint64_t quantile(double q) const noexcept {
+            if (m_count == 0)
+                return 0;
+            const auto rank = static_cast<std::uint64_t>(q * static_cast<double>(m_count - 1)) + 1;
+            std::uint64_t seen = 0;
+            for (std::size_t idx = 0; idx < s_buckets; ++idx)
+                if (seen += m_counts[idx]; seen >= rank)
+                    return bucket_high(idx);
+            return bucket_high(s_buckets - 1);
+        }
+    };
+
+    static std::size_t bucket(std::uint64_t cycles) noexcept {
+        if (cycles < s_linear)
+            return static_cast<std::size_t>(cycles);
+        const unsigned exp = 63 - static_cast<unsigned>(__builtin_clzll(cycles));
+        return ((exp - s_sub_bits) << s_sub_bits) + static_cast<std::size_t>(cycles >> (exp - s_sub_bits));
+    }
+
+    static std::uint64_t bucket_low(std::size_t idx) noexcept {
+        if (idx < s_linear)
+            return idx;
+        const unsigned shift = static_cast<unsigned>(idx >> s_sub_bits) - 1;
+        return (std::uint64_t{1 << s_sub_bits} | (idx & ((1 << s_sub_bits) - 1))) << shift;
+    }
+
+    static std::uint64_t bucket_high(std::size_t idx) noexcept {
+        return idx + 1 < s_buckets ? bucket_low(idx + 1) - 1 : ~std::uint64_t{0};
+    }
+
+    // called by the writer only, so counters aren't incremented by locked instructions
+    void record(std::uint64_t cycles) noexcept {
+        auto& counter = m_counts[bucket(cycles)];
+        counter.store(counter.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    }
+
+    // counts may be torn between buckets being recorded meanwhile, but every one is consistent
+    snapshot take_snapshot() const noexcept {
+        snapshot res;
+        for (std::size_t idx = 0; idx < s_buckets; ++idx) {
+            res.m_counts[idx] = m_counts[idx].load(std::memory_order_relaxed);
+            res.m_count += res.m_counts[idx];
+        }
+        return res;
+    }
+
+private:
+    std::array<std::atomic<std::uint64_t>, s_buckets> m_counts{};
+};
+
+/*
+ * Two cooperating threads: the sender calls send() and the receiver calls receive() often, e.g.
+ * on every iteration of their loops. The sender stores its TSC at most once per the period and
+ * only after the receiver has taken the previous message, so messages never queue up.
+ */
+class latency_probe {
+    // the timestamped line, written by the sender only
+    alignas(g_cache_line_size) std::atomic<std::uint64_t> m_stamp{0};
+    // the last stamp taken, written by the receiver only
+    alignas(g_cache_line_size) std::atomic<std::uint64_t> m_taken{0};
+    std::uint64_t m_last_seen = 0;
+    latency_histogram m_histogram;
+    // state of the sender
+    alignas(g_cache_line_size) std::uint64_t m_period_cycles;
+    std::uint64_t m_last_sent = 0;
+
+public:
+    // the period in TSC cycles, see get_cpu_freq_ghz() to convert it from time
+    explicit latency_probe(std::uint64_t period_cycles) noexcept : m_period_cycles{period_cycles} {}
+    latency_probe(const latency_probe&) = delete;
+
+    // returns true if a message is sent
+    bool send() noexcept {
+        const auto now = rdtsc();
+        if (now - m_last_sent < m_period_cycles || m_taken.load(std::memory_order_relaxed) != m_last_sent)
+            return false;
+        m_last_sent = now;
+        m_stamp.store(now, std::memory_order_relaxed);
+        return true;
+    }
+
+    // returns true if a message is received
+    bool receive() noexcept {
+        const auto stamp = m_stamp.load(std::memory_order_relaxed);
+        if (stamp == m_last_seen)
+            return false;
+        const auto now = rdtsc();
+        m_last_seen = stamp;
+        // TSCs of different cores may be slightly out of sync
+        m_histogram.record(now > stamp ? now - stamp : 0);
+        m_taken.store(stamp, std::memory_order_relaxed);
+        return true;
+    }
+
+    // may be called by any thread
+    latency_histogram::snapshot snapshot() const noexcept { return m_histogram.take_snapshot(); }
+};
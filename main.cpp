@@ -1,27 +1,42 @@
 // vim: textwidth=100
-#include "tests.h"
+#include "cachelineperf.h"
+#include "topology.h"
+#include "preflight.h"
+#include "results.h"
+#include "heatmap.h"
+#include "tsc.h"
+#include "cpufreq.h"
+#include "metrics.h"
 
 #include <cstddef>
 #include <cstdint>
+#include <cerrno>
+#include <cmath>
+#include <csignal>
 #include <cstring>
 #include <string>
+#include <iomanip>
 #include <iostream>
 #include <sstream>
-#include <fstream>
-#include <atomic>
 #include <algorithm>
-#include <exception>
+#include <chrono>
+#include <deque>
 #include <memory>
-#include <thread>
+#include <optional>
+#include <stdexcept>
+#include <utility>
 #include <string_view>
 #include <system_error>
+#include <vector>
 
-#include <pthread.h>
+#include <sched.h>
+#include <signal.h>
+#include <time.h>
 
 /*
  * Preconditions which a system this test is run on should meet:
  *   1. Isolated CPU cores dedicated for the test (throw out OS, other processes, IRQs, kernel
- *      deferred tasks, timers, etc.)
+ *      deferred tasks, timers, etc.). It's checked before running a test, see --preflight.
  *
  * Notes:
  *   * The implementation uses posix calls so it can't compile on OSs other than posix-based like
@@ -32,96 +47,249 @@
  *     execution.
  */
 
-// like std::latch, but without going into kernel space
-class spin_latch {
-    std::atomic<std::ptrdiff_t> m_counter;
-public:
-    explicit spin_latch(std::ptrdiff_t expected) : m_counter(expected) {}
-    spin_latch(const spin_latch&) = delete;
-    void arrive_and_wait(std::ptrdiff_t n = 1) noexcept {
-        if (m_counter.fetch_sub(n, std::memory_order_relaxed) == n)
-            return;
-        while (m_counter.load(std::memory_order_relaxed) != 0)
-            ;
-    }
+// convert a command line argument into a number, return false if it isn't acceptable
+template <typename T>
+bool parse_arg(const char* arg, T& value) {
+    std::istringstream is{arg};
+    is >> value;
+    return ! (is.fail() || is.bad() || ! is.eof());
+}
+
+// convert a huge page size argument into bytes
+bool parse_page_size(std::string_view arg, std::size_t& value) {
+    using namespace std::string_view_literals;
+
+    if ("2m"sv == arg)
+        value = std::size_t{1} << 21;
+    else if ("1g"sv == arg)
+        value = std::size_t{1} << 30;
+    else
+        return false;
+    return true;
+}
+
+enum class preflight_mode {
+    off,
+    warn,
+    strict
 };
 
-class test_runner {
-    const unsigned short m_cpuids[2];
-    std::exception_ptr m_errors[2];
-    spin_latch m_start_barrier;
-public:
-    explicit test_runner(unsigned short t1_cpuid, unsigned short t2_cpuid)
-        : m_cpuids{t1_cpuid, t2_cpuid}, m_start_barrier{2} {
+// check isolation of the CPU cores used by workers, return false if the test shouldn't be run
+bool preflight(std::vector<unsigned short> cpuids, preflight_mode mode) {
+    if (mode == preflight_mode::off)
+        return true;
+
+    std::sort(cpuids.begin(), cpuids.end());
+    cpuids.erase(std::unique(cpuids.begin(), cpuids.end()), cpuids.end());
+
+    const auto issues = check_isolation(cpuids);
+    for (const auto& issue : issues)
+        std::cerr << (mode == preflight_mode::strict ? "error: " : "warning: ") << issue << std::endl;
+
+    if (! issues.empty() && mode == preflight_mode::strict) {
+        std::cerr << "CPU cores aren't isolated, refusing to run the test" << std::endl;
+        return false;
     }
+    return true;
+}
 
-    // Run two threads, bind them to specified CPU cores and execute the test case on them
-    int run(std::unique_ptr<test_case_iface> test_case) {
-        int res = 0;
-        std::thread t1{[this, &test_case](){
-            try {
-                set_thread_affinity(m_cpuids[0]);
-                test_case->one_prepare();
-            } catch (...) {
-                m_errors[0] = std::current_exception();
-            }
+// a regression is a statistically significant shift of the samples which is large enough
+constexpr double g_regression_p_value = 0.001;
 
-            m_start_barrier.arrive_and_wait();
-            if (m_errors[1])
-                return;
+// compare the result with the baseline one, return true if it's a regression
+bool compare_with_baseline(const test_result& baseline, const test_result& result, double threshold) {
+    const auto baseline_median = histogram_median(baseline.m_histogram);
+    const auto median = histogram_median(result.m_histogram);
+    const auto change = baseline_median != 0.0 ? (median - baseline_median) / baseline_median : 0.0;
+    const auto test = mann_whitney(baseline.m_histogram, result.m_histogram);
+    const bool regression = test.m_p_value < g_regression_p_value && change > threshold;
 
-            test_case->one_work();
-        }};
-        std::thread t2{[this, &test_case](){
-            try {
-                set_thread_affinity(m_cpuids[1]);
-                test_case->another_prepare();
-            } catch (...) {
-                m_errors[1] = std::current_exception();
-            }
+    std::cout << "Comparison with the baseline:\n"
+        "  baseline median: " << baseline_median << " cycles\n"
+        "  median         : " << median << " cycles (" << std::showpos << change * 100 << std::noshowpos << "%)\n"
+        "  Mann-Whitney   : z " << test.m_z << ", p " << test.m_p_value << " (one-sided, greater)\n"
+        "  verdict        : " << (regression ? "regression" : "no significant regression") << "\n" << std::endl;
+    return regression;
+}
 
-            m_start_barrier.arrive_and_wait();
-            if (m_errors[0])
-                return;
+/*
+ * Run the two-sided test case with the frequency of the CPU cores pinned to every available step
+ * in turn and report latency in TSC cycles, nanoseconds and core cycles per step. The original
+ * frequency limits are restored at the end.
+ */
+int frequency_sweep(measurement request, unsigned mode, const std::vector<unsigned short>& cpuids, unsigned steps) {
+    using namespace std::string_view_literals;
+
+    const auto frequencies = available_frequencies_khz(cpuids[0], steps);
+    if (frequencies.empty()) {
+        std::cerr << "cpufreq isn't available for cpu "sv << cpuids[0] << std::endl;
+        return 1;
+    }
+
+    std::optional<frequency_lock> lock;
+    try {
+        lock.emplace(cpuids);
+    } catch (const std::system_error& e) {
+        std::cerr << e.what() << std::endl;
+        return 1;
+    }
 
-            test_case->another_work();
-        }};
+    const auto tsc_ghz = get_cpu_freq_ghz();
+    std::cout << "Frequency sweep, TSC "sv << tsc_ghz << " GHz:\n"sv
+        << "  "sv << std::setw(10) << "set, MHz"sv << std::setw(15) << "measured, MHz"sv
+        << std::setw(15) << "median, cycles"sv << std::setw(12) << "median, ns"sv
+        << std::setw(15) << "core cycles"sv << std::setw(12) << "p99, ns"sv << std::endl;
 
-        t1.join();
-        t2.join();
+    request.set_mode(mode);
+    request.set_cpuids(cpuids);
+    request.set_quiet(true);
 
-        unsigned short worker_idx = 1;
-        for (auto& exc_ptr : m_errors) {
-            if (exc_ptr)
-                try {
-                    res = 1;
-                    std::rethrow_exception(exc_ptr);
-                } catch (const std::exception& e) {
-                    std::cerr << "unexpected exception at worker " << worker_idx
-                        << ": " << e.what() << std::endl;
-                } catch (...) {
-                    std::cerr << "unexpected error at worker " << worker_idx << std::endl;
-                }
-            ++worker_idx;
+    for (auto khz : frequencies) {
+        measurement_result res;
+        try {
+            lock->set(khz);
+            res = measure(request);
+        } catch (const std::invalid_argument& e) {
+            std::cerr << e.what() << std::endl;
+            return 1;
+        } catch (const std::system_error& e) {
+            std::cerr << e.what() << std::endl;
+            return 1;
+        }
+        if (res.m_status != 0)
+            return res.m_status;
+        if (! res.m_samples) {
+            std::cerr << "mode "sv << mode << " doesn't provide samples to be swept"sv << std::endl;
+            return 1;
         }
+        if (res.m_samples->empty())
+            continue;
 
-        if (res == 0) {
-            std::cout << "Test case result:" << std::endl;
-            test_case->report(std::cout);
-            std::cout << std::endl;
+        const auto core_ghz = core_to_tsc_ratio(cpuids[0]) * tsc_ghz;
+        std::cout << "  "sv << std::setw(10) << khz / 1000 << std::setw(15) << std::lround(core_ghz * 1000)
+            << std::setw(15) << res.m_median << std::setw(12) << res.m_median / tsc_ghz
+            << std::setw(15) << res.m_median / tsc_ghz * core_ghz << std::setw(12) << res.m_p99 / tsc_ghz << std::endl;
+    }
+
+    return 0;
+}
+
+// reports the mode if it doesn't provide samples to be used as said
+bool provides_samples(unsigned mode, std::string_view usage) {
+    using namespace std::string_view_literals;
+
+    try {
+        if (mode_provides_samples(mode))
+            return true;
+        std::cerr << "mode "sv << mode << " doesn't provide samples to be "sv << usage << std::endl;
+    } catch (const std::system_error& e) {
+        std::cerr << "unable to allocate test data: "sv << e.what() << std::endl;
+    }
+    return false;
+}
+
+volatile std::sig_atomic_t g_stop_requested = 0;
+
+extern "C" void request_stop(int) {
+    g_stop_requested = 1;
+}
+
+/*
+ * Run the two-sided tests round after round, a round is started every interval and the tests of
+ * a round are run one by one, so the CPU cores are busy for a small share of time if the tests
+ * are short. Samples of the last rounds of the window are exported as metrics after every round.
+ * Stops on SIGTERM or SIGINT, the metrics of the last round are left in place.
+ */
+int run_daemon(std::vector<test_result> tests, const measurement& request, std::chrono::seconds interval,
+        std::size_t window, const std::string& metrics_path) {
+    using namespace std::string_view_literals;
+
+    struct sigaction action{};
+    action.sa_handler = request_stop;
+    sigemptyset(&action.sa_mask);
+    // no SA_RESTART, so sleeping between rounds is interrupted
+    for (auto signal : {SIGTERM, SIGINT})
+        if (sigaction(signal, &action, nullptr) != 0) {
+            std::cerr << "unable to set a signal handler: "sv << std::strerror(errno) << std::endl;
+            return 1;
         }
 
-        return res;
+    const auto tsc_ghz = get_cpu_freq_ghz();
+    // histograms of the rounds within the window for every test
+    std::vector<std::deque<histogram>> rounds_histograms(tests.size());
+    // measurements are kept between rounds, so their sample buffers aren't mapped every round
+    std::vector<measurement> requests(tests.size(), request);
+    for (std::size_t idx = 0; idx < tests.size(); ++idx) {
+        requests[idx].set_mode(tests[idx].m_mode);
+        requests[idx].set_cpuids(tests[idx].m_cpuids);
+        requests[idx].set_attempts(tests[idx].m_attempts);
+        requests[idx].set_quiet(true);
     }
-private:
-    static void set_thread_affinity(unsigned short cpuid) {
-        cpu_set_t cpu_set;
-        CPU_ZERO(&cpu_set);
-        CPU_SET(cpuid, &cpu_set);
-        if (auto res = pthread_setaffinity_np(pthread_self(), sizeof(cpu_set_t), &cpu_set); res != 0)
-            throw std::system_error{std::make_error_code((std::errc)res), "unable to set thread affinity"};
+    // warnings are the same every round, so they are reported for the first one only
+    std::ostringstream later_log;
+
+    std::cout << "Running "sv << tests.size() << " tests every "sv << interval.count()
+        << "s, metrics are written to "sv << metrics_path << std::endl;
+
+    for (std::uint64_t round = 0; ! g_stop_requested; ++round) {
+        const auto round_start = std::chrono::steady_clock::now();
+
+        for (std::size_t idx = 0; idx < tests.size() && ! g_stop_requested; ++idx) {
+            auto& test = tests[idx];
+            requests[idx].set_output(&std::cout, round == 0 ? &std::cerr : &later_log);
+
+            later_log.str({});
+            measurement_result res;
+            try {
+                res = measure(requests[idx]);
+            } catch (const std::invalid_argument& e) {
+                std::cerr << e.what() << std::endl;
+                return 1;
+            } catch (const std::system_error& e) {
+                std::cerr << "unable to allocate test data: "sv << e.what() << std::endl;
+                return 1;
+            }
+            if (res.m_status != 0) {
+                std::cerr << later_log.str();
+                return res.m_status;
+            }
+
+            if (! res.m_samples) {
+                std::cerr << "mode "sv << test.m_mode << " doesn't provide samples to be exported"sv << std::endl;
+                return 1;
+            }
+            auto& histograms = rounds_histograms[idx];
+            histograms.push_back(make_histogram(*res.m_samples));
+            if (histograms.size() > window)
+                histograms.pop_front();
+
+            test.m_histogram.clear();
+            for (const auto& hist : histograms)
+                merge_histogram(test.m_histogram, hist);
+        }
+
+        if (g_stop_requested)
+            break;
+
+        try {
+            write_metrics(metrics_path, tests, tsc_ghz, round + 1);
+        } catch (const std::runtime_error& e) {
+            std::cerr << "unable to write metrics: "sv << e.what() << std::endl;
+            return 1;
+        }
+
+        const auto remaining = round_start + interval - std::chrono::steady_clock::now();
+        if (remaining.count() <= 0)
+            continue;
+        const auto remaining_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(remaining).count();
+        timespec ts{static_cast<time_t>(remaining_ns / 1'000'000'000), static_cast<long>(remaining_ns % 1'000'000'000)};
+        while (nanosleep(&ts, &ts) != 0 && ! g_stop_requested)
+            ;
     }
-};
+
+    std::cout << "Stopped"sv << std::endl;
+    return 0;
+}
 
 int usage(const char* basename) {
     if (auto p = std::strrchr(basename, '/'))
@@ -137,8 +305,80 @@ int usage(const char* basename) {
         "Options:\n"
         "  --t1-cpuid N - CPU ID of a CPU core a worker 1 should be bound to\n"
         "  --t2-cpuid N - CPU ID of a CPU core a worker 2 should be bound to\n"
+        "  --cpuids LIST - CPU IDs of CPU cores workers should be bound to in order, like\n"
+        "      \"0-3,8\"; required by tests having more than two workers\n"
         "  --attempts N - number of attempts for the test (default: 1000)\n"
-        "  --mode N - test mode [0-3] (default: 0)" << std::endl;
+        "  --adaptive-ci PERCENT - repeat runs of N attempts of modes 0-3 and 13 until 95%\n"
+        "      confidence intervals of the median and the 99th percentile are narrower than\n"
+        "      PERCENT of their values\n"
+        "  --time-budget SECONDS - stop repeating runs after this time (default: 60)\n"
+        "  --timeline SECONDS - repeat runs of modes 0-3 and 13 for the time budget and report\n"
+        "      percentiles of samples and the core frequency relative to TSC for every period\n"
+        "      of SECONDS, e.g. to see drift during a soak\n"
+        "  --mem-node N - NUMA node the data exchanged by two-sided tests is placed on\n"
+        "      (default: the node of the first touch)\n"
+        "  --slot-size N - size of a slot every piece of the data exchanged by two-sided\n"
+        "      tests is placed in, e.g. 128 to not share a pair of cache lines fetched\n"
+        "      together by the spatial prefetcher (default: 64)\n"
+        "  --huge-pages 2m|1g - place the data exchanged by two-sided tests on huge pages\n"
+        "  --sample-pages 2m|1g - place buffers for samples collected by workers on huge pages\n"
+        "  --lock-memory - lock the test data and sample buffers in RAM\n"
+        "  --jitter-threshold N - detect interruptions of workers in mode 0 as gaps longer than N\n"
+        "      cycles between TSC readings in their waiting loops, and exclude samples overlapping\n"
+        "      them (default: 0, disabled)\n"
+        "  --perf - count hardware performance events (or software ones if there is no PMU)\n"
+        "      during the main part of every worker\n"
+        "  --perf-raw-event CODE - count a model specific event given by its hex code in addition,\n"
+        "      e.g. a snoop HITM event of the CPU; can be repeated\n"
+        "  --preflight off|warn|strict - check the CPU cores are isolated (kernel parameters,\n"
+        "      IRQ affinities, cpufreq governor, C-states) and warn or refuse to run if they\n"
+        "      aren't (default: warn)\n"
+        "  --idle-us N - idle period of the receiver before every attempt in the wake from idle\n"
+        "      test, in microseconds (default: 100)\n"
+        "  --idle-kind sleep|pause - how the receiver idles: in nanosleep() letting the core\n"
+        "      enter a C-state or spinning on the pause instruction (default: sleep)\n"
+        "  --sched fifo|rr - run workers under SCHED_FIFO or SCHED_RR real-time policy\n"
+        "  --sched-priority N - real-time priority of workers (default: the policy's minimum)\n"
+        "  --mlockall - lock all the process memory in RAM\n"
+        "  --no-deep-cstates - keep CPU cores out of C-states with non-zero exit latency while\n"
+        "      the test is run (via /dev/cpu_dma_latency)\n"
+        "  --freq-sweep - run a test of modes 0-3 and 13 with frequency of both CPU cores\n"
+        "      pinned to every step available via cpufreq and report latency per step\n"
+        "  --freq-steps N - steps between the minimal and the maximal frequencies if the cpufreq\n"
+        "      driver doesn't list available frequencies (default: 5)\n"
+        "  --min-timer-slack - set timer slack of workers to 1ns\n"
+        "  --processes - run workers of two-sided tests in separate processes communicating\n"
+        "      through shared memory instead of threads\n"
+        "  --save-results FILE - save samples of modes 0-3 and 13 to a JSON file to be used as\n"
+        "      a baseline\n"
+        "  --baseline FILE - run the tests saved in the file on the same CPU cores, compare their\n"
+        "      samples with the saved ones and exit with code 2 if any test has regressed\n"
+        "  --dump-samples FILE - write raw samples of modes 0-3 and 13 to a binary file to be\n"
+        "      analyzed offline, e.g. by cacheline_dump_stats\n"
+        "  --sweep LIST - run a two-sided test of modes 0-3 and 13 for every ordered pair of\n"
+        "      CPU cores of the list, like \"0-15\", and print a heatmap of median latencies\n"
+        "      ordered by topology (package, last level cache, core)\n"
+        "  --heatmap FILE - save the heatmap of the sweep as an SVG image\n"
+        "  --daemon - run the tests round after round until SIGTERM and export latency\n"
+        "      percentiles of the last rounds to the metrics file in the Prometheus text format;\n"
+        "      the tests are the modes given by --modes on the pair given by cpu ids or on every\n"
+        "      pair of the --sweep list\n"
+        "  --modes LIST - two-sided modes run by the daemon, like \"0,13\" (default: --mode)\n"
+        "  --interval SECONDS - period of rounds of the daemon (default: 60)\n"
+        "  --window N - number of the last rounds the daemon exports samples of (default: 60)\n"
+        "  --metrics-file FILE - where the daemon writes metrics to, e.g. for the node exporter's\n"
+        "      textfile collector\n"
+        "  --regression-threshold PERCENT - minimal growth of the median considered as a\n"
+        "      regression if it's statistically significant (default: 5)\n"
+        "  --producers N - number of producers in the queue tests (default: 1)\n"
+        "  --consumers N - number of consumers in the queue and ring tests (default: 1)\n"
+        "  --readers N - number of readers in the seqlock test (default: 1)\n"
+        "  --record-lines N - size of the record in the seqlock test in cache lines (default: 1)\n"
+        "  --incrementers N - number of incrementing workers in the counter tests (default: 1)\n"
+        "  --mode N - test mode [0-" << modes_count() - 1 << "] (default: 0)\n";
+    for (unsigned mode = 0; mode < modes_count(); ++mode)
+        std::cout << "      " << mode << " - " << mode_name(mode) << "\n";
+    std::cout.flush();
     return 0;
 }
 
@@ -146,8 +386,45 @@ int main(int argc, const char* argv[]) {
     using namespace std::string_view_literals;
 
     short cpuids[2]{-1, -1};
-    test_case_iface::config test_case_cfg;
-    std::unique_ptr<test_case_iface> test_case;
+    std::vector<unsigned short> cpu_list;
+    std::uint32_t attempts = 1000;
+    std::uint16_t producers = 1;
+    std::uint16_t consumers = 1;
+    std::uint16_t readers = 1;
+    std::uint16_t incrementers = 1;
+    std::uint16_t record_lines = 1;
+    memory_placement data_memory;
+    std::size_t slot_size = 64;
+    memory_placement samples_memory;
+    std::uint64_t jitter_threshold = 0;
+    std::uint32_t idle_us = 100;
+    auto idle_how = measurement::idle::sleep;
+    unsigned mode = 0;
+    bool use_processes = false;
+    std::string save_path;
+    std::string baseline_path;
+    double regression_threshold = 0.05;
+    std::vector<unsigned short> sweep_cpus;
+    std::string heatmap_path;
+    std::string dump_path;
+    bool freq_sweep = false;
+    unsigned freq_steps = 5;
+    bool daemon = false;
+    std::vector<unsigned> daemon_modes;
+    std::chrono::seconds daemon_interval{60};
+    std::size_t daemon_window = 60;
+    std::string metrics_path;
+    bool no_deep_cstates = false;
+    bool perf_counters = false;
+    std::vector<std::uint64_t> raw_perf_events;
+    int sched_policy = SCHED_OTHER;
+    int sched_priority = 0;
+    bool lock_all = false;
+    bool min_timer_slack = false;
+    double adaptive_ci = 0.0;
+    std::chrono::seconds time_budget{60};
+    std::chrono::seconds timeline_bucket{0};
+    preflight_mode preflight_check = preflight_mode::warn;
 
     if (argc == 1)
         return usage(argv[0]);
@@ -157,12 +434,35 @@ int main(int argc, const char* argv[]) {
             return usage(argv[0]);
         else if ("--attempts"sv == argv[i] && i + 1 < argc) {
             std::istringstream is{argv[++i]};
-            is >> test_case_cfg.m_attempts_count;
+            is >> attempts;
             if (is.fail() || is.bad() || ! is.eof()) {
                 std::cerr << "unable to convert attempts argument into an acceptable number"sv << std::endl;
                 return 1;
             }
         }
+        else if ("--adaptive-ci"sv == argv[i] && i + 1 < argc) {
+            if (! parse_arg(argv[++i], adaptive_ci) || adaptive_ci <= 0.0) {
+                std::cerr << "unable to convert adaptive ci argument into an acceptable number"sv << std::endl;
+                return 1;
+            }
+            adaptive_ci /= 100.0;
+        }
+        else if ("--time-budget"sv == argv[i] && i + 1 < argc) {
+            unsigned seconds;
+            if (! parse_arg(argv[++i], seconds) || seconds == 0) {
+                std::cerr << "unable to convert time budget argument into an acceptable number"sv << std::endl;
+                return 1;
+            }
+            time_budget = std::chrono::seconds{seconds};
+        }
+        else if ("--timeline"sv == argv[i] && i + 1 < argc) {
+            unsigned seconds;
+            if (! parse_arg(argv[++i], seconds) || seconds == 0) {
+                std::cerr << "unable to convert timeline argument into an acceptable number"sv << std::endl;
+                return 1;
+            }
+            timeline_bucket = std::chrono::seconds{seconds};
+        }
         else if ("--t1-cpuid"sv == argv[i] && i + 1 < argc) {
             std::istringstream is{argv[++i]};
             unsigned short v;
@@ -183,34 +483,543 @@ int main(int argc, const char* argv[]) {
             }
             cpuids[1] = static_cast<short>(v);
         }
-        else if ("--mode"sv == argv[i] && i + 1 < argc) {
-            if ("0"sv == argv[i + 1])
-                test_case = std::make_unique<one_side_test>();
-            else if ("1"sv == argv[i + 1])
-                test_case = std::make_unique<one_side_asm_test>();
-            else if ("2"sv == argv[i + 1])
-                test_case = std::make_unique<ping_pong_test>();
-            else if ("3"sv == argv[i + 1])
-                test_case = std::make_unique<one_side_asm_relax_branch_pred_test>();
+        else if ("--cpuids"sv == argv[i] && i + 1 < argc) {
+            try {
+                cpu_list.clear();
+                for (auto cpuid : parse_cpu_list(argv[++i]))
+                    cpu_list.push_back(static_cast<unsigned short>(cpuid));
+            } catch (const std::invalid_argument& e) {
+                std::cerr << "unable to convert cpu ids list: "sv << e.what() << std::endl;
+                return 1;
+            }
+        }
+        else if ("--mem-node"sv == argv[i] && i + 1 < argc) {
+            if (! parse_arg(argv[++i], data_memory.m_numa_node) || data_memory.m_numa_node < 0) {
+                std::cerr << "unable to convert mem node argument into an acceptable number"sv << std::endl;
+                return 1;
+            }
+        }
+        else if ("--slot-size"sv == argv[i] && i + 1 < argc) {
+            // the size is checked once the data memory is set
+            if (! parse_arg(argv[++i], slot_size)) {
+                std::cerr << "unable to convert slot size argument into an acceptable number"sv << std::endl;
+                return 1;
+            }
+        }
+        else if ("--huge-pages"sv == argv[i] && i + 1 < argc) {
+            if (! parse_page_size(argv[++i], data_memory.m_page_size)) {
+                std::cerr << "unknown huge page size value"sv << std::endl;
+                return 1;
+            }
+        }
+        else if ("--sample-pages"sv == argv[i] && i + 1 < argc) {
+            if (! parse_page_size(argv[++i], samples_memory.m_page_size)) {
+                std::cerr << "unknown huge page size value"sv << std::endl;
+                return 1;
+            }
+        }
+        else if ("--preflight"sv == argv[i] && i + 1 < argc) {
+            if ("off"sv == argv[++i])
+                preflight_check = preflight_mode::off;
+            else if ("warn"sv == argv[i])
+                preflight_check = preflight_mode::warn;
+            else if ("strict"sv == argv[i])
+                preflight_check = preflight_mode::strict;
+            else {
+                std::cerr << "unknown preflight mode value"sv << std::endl;
+                return 1;
+            }
+        }
+        else if ("--jitter-threshold"sv == argv[i] && i + 1 < argc) {
+            if (! parse_arg(argv[++i], jitter_threshold)) {
+                std::cerr << "unable to convert jitter threshold argument into an acceptable number"sv << std::endl;
+                return 1;
+            }
+        }
+        else if ("--idle-us"sv == argv[i] && i + 1 < argc) {
+            if (! parse_arg(argv[++i], idle_us)) {
+                std::cerr << "unable to convert idle period argument into an acceptable number"sv << std::endl;
+                return 1;
+            }
+        }
+        else if ("--idle-kind"sv == argv[i] && i + 1 < argc) {
+            if ("sleep"sv == argv[++i])
+                idle_how = measurement::idle::sleep;
+            else if ("pause"sv == argv[i])
+                idle_how = measurement::idle::pause;
             else {
+                std::cerr << "unknown idle kind value"sv << std::endl;
+                return 1;
+            }
+        }
+        else if ("--sched"sv == argv[i] && i + 1 < argc) {
+            if ("fifo"sv == argv[++i])
+                sched_policy = SCHED_FIFO;
+            else if ("rr"sv == argv[i])
+                sched_policy = SCHED_RR;
+            else {
+                std::cerr << "unknown scheduling policy value"sv << std::endl;
+                return 1;
+            }
+        }
+        else if ("--sched-priority"sv == argv[i] && i + 1 < argc) {
+            if (! parse_arg(argv[++i], sched_priority) || sched_priority <= 0) {
+                std::cerr << "unable to convert scheduling priority into an acceptable number"sv << std::endl;
+                return 1;
+            }
+        }
+        else if ("--no-deep-cstates"sv == argv[i])
+            no_deep_cstates = true;
+        else if ("--freq-sweep"sv == argv[i])
+            freq_sweep = true;
+        else if ("--freq-steps"sv == argv[i] && i + 1 < argc) {
+            if (! parse_arg(argv[++i], freq_steps) || freq_steps == 0) {
+                std::cerr << "unable to convert frequency steps argument into an acceptable number"sv << std::endl;
+                return 1;
+            }
+        }
+        else if ("--mlockall"sv == argv[i])
+            lock_all = true;
+        else if ("--min-timer-slack"sv == argv[i])
+            min_timer_slack = true;
+        else if ("--perf"sv == argv[i])
+            perf_counters = true;
+        else if ("--perf-raw-event"sv == argv[i] && i + 1 < argc) {
+            std::istringstream is{argv[++i]};
+            std::uint64_t code;
+            is >> std::hex >> code;
+            if (is.fail() || is.bad() || ! is.eof()) {
+                std::cerr << "unable to convert raw event code into an acceptable number"sv << std::endl;
+                return 1;
+            }
+            perf_counters = true;
+            raw_perf_events.push_back(code);
+        }
+        else if ("--processes"sv == argv[i])
+            use_processes = true;
+        else if ("--lock-memory"sv == argv[i]) {
+            data_memory.m_lock = true;
+            samples_memory.m_lock = true;
+        }
+        else if ("--producers"sv == argv[i] && i + 1 < argc) {
+            if (! parse_arg(argv[++i], producers) || producers == 0) {
+                std::cerr << "unable to convert producers argument into an acceptable number"sv << std::endl;
+                return 1;
+            }
+        }
+        else if ("--consumers"sv == argv[i] && i + 1 < argc) {
+            if (! parse_arg(argv[++i], consumers) || consumers == 0) {
+                std::cerr << "unable to convert consumers argument into an acceptable number"sv << std::endl;
+                return 1;
+            }
+        }
+        else if ("--readers"sv == argv[i] && i + 1 < argc) {
+            if (! parse_arg(argv[++i], readers) || readers == 0) {
+                std::cerr << "unable to convert readers argument into an acceptable number"sv << std::endl;
+                return 1;
+            }
+        }
+        else if ("--record-lines"sv == argv[i] && i + 1 < argc) {
+            if (! parse_arg(argv[++i], record_lines) || record_lines == 0) {
+                std::cerr << "unable to convert record lines argument into an acceptable number"sv << std::endl;
+                return 1;
+            }
+        }
+        else if ("--incrementers"sv == argv[i] && i + 1 < argc) {
+            if (! parse_arg(argv[++i], incrementers) || incrementers == 0) {
+                std::cerr << "unable to convert incrementers argument into an acceptable number"sv << std::endl;
+                return 1;
+            }
+        }
+        else if ("--save-results"sv == argv[i] && i + 1 < argc)
+            save_path = argv[++i];
+        else if ("--baseline"sv == argv[i] && i + 1 < argc)
+            baseline_path = argv[++i];
+        else if ("--sweep"sv == argv[i] && i + 1 < argc) {
+            try {
+                sweep_cpus.clear();
+                for (auto cpuid : parse_cpu_list(argv[++i]))
+                    sweep_cpus.push_back(static_cast<unsigned short>(cpuid));
+            } catch (const std::invalid_argument& e) {
+                std::cerr << "unable to convert sweep cpu ids list: "sv << e.what() << std::endl;
+                return 1;
+            }
+        }
+        else if ("--heatmap"sv == argv[i] && i + 1 < argc)
+            heatmap_path = argv[++i];
+        else if ("--dump-samples"sv == argv[i] && i + 1 < argc)
+            dump_path = argv[++i];
+        else if ("--regression-threshold"sv == argv[i] && i + 1 < argc) {
+            if (! parse_arg(argv[++i], regression_threshold) || regression_threshold < 0.0) {
+                std::cerr << "unable to convert regression threshold argument into an acceptable number"sv << std::endl;
+                return 1;
+            }
+            regression_threshold /= 100.0;
+        }
+        else if ("--daemon"sv == argv[i])
+            daemon = true;
+        else if ("--modes"sv == argv[i] && i + 1 < argc) {
+            try {
+                // modes are listed the same way as cpu ids
+                daemon_modes = parse_cpu_list(argv[++i]);
+            } catch (const std::invalid_argument& e) {
+                std::cerr << "unable to convert modes list: "sv << e.what() << std::endl;
+                return 1;
+            }
+        }
+        else if ("--interval"sv == argv[i] && i + 1 < argc) {
+            unsigned seconds;
+            if (! parse_arg(argv[++i], seconds) || seconds == 0) {
+                std::cerr << "unable to convert interval argument into an acceptable number"sv << std::endl;
+                return 1;
+            }
+            daemon_interval = std::chrono::seconds{seconds};
+        }
+        else if ("--window"sv == argv[i] && i + 1 < argc) {
+            if (! parse_arg(argv[++i], daemon_window) || daemon_window == 0) {
+                std::cerr << "unable to convert window argument into an acceptable number"sv << std::endl;
+                return 1;
+            }
+        }
+        else if ("--metrics-file"sv == argv[i] && i + 1 < argc)
+            metrics_path = argv[++i];
+        else if ("--mode"sv == argv[i] && i + 1 < argc) {
+            if (! parse_arg(argv[++i], mode) || mode >= modes_count()) {
                 std::cerr << "unknown test mode value"sv << std::endl;
                 return 1;
             }
-            ++i;
         } else {
             std::cerr << "unknown option \""sv << argv[i] << "\" or there is no mandatory argument"sv << std::endl;
             return 1;
         }
     }
 
-    if (cpuids[0] == -1 || cpuids[1] == -1) {
-        std::cerr << "some of cpu ids wasn't provided"sv << std::endl;
+    // --t1-cpuid and --t2-cpuid take precedence over the first items of the CPU ids list
+    bool cpuids_provided = true;
+    for (std::size_t idx = 0; idx < 2; ++idx)
+        if (cpuids[idx] == -1)
+            cpuids_provided = cpuids_provided && idx < cpu_list.size();
+        else {
+            if (cpu_list.size() <= idx)
+                cpu_list.resize(idx + 1);
+            cpu_list[idx] = static_cast<unsigned short>(cpuids[idx]);
+        }
+
+    // the configuration shared by all the tests to run, every test sets its mode and cpu ids
+    measurement request;
+    try {
+        request.set_mode(mode);
+        request.set_attempts(attempts);
+        request.set_producers(producers);
+        request.set_consumers(consumers);
+        request.set_readers(readers);
+        request.set_incrementers(incrementers);
+        request.set_record_lines(record_lines);
+        request.set_data_memory(data_memory, slot_size);
+        request.set_samples_memory(samples_memory);
+        request.set_jitter_threshold(jitter_threshold);
+        request.set_idle(idle_us, idle_how);
+        request.set_processes(use_processes);
+        request.set_perf_counters(perf_counters, raw_perf_events);
+        if (sched_policy != SCHED_OTHER)
+            request.set_scheduling(sched_policy, sched_priority ? sched_priority : sched_get_priority_min(sched_policy));
+        request.set_lock_all(lock_all);
+        request.set_min_timer_slack(min_timer_slack);
+        request.set_adaptive_ci(adaptive_ci);
+        request.set_timeline(timeline_bucket);
+        request.set_time_budget(time_budget);
+        request.set_output(&std::cout, &std::cerr);
+    } catch (const std::invalid_argument& e) {
+        std::cerr << e.what() << std::endl;
         return 1;
     }
 
-    if (! test_case)
-        test_case = std::make_unique<one_side_test>();
+    std::optional<cpu_latency_lock> latency_lock;
+    if (no_deep_cstates)
+        try {
+            latency_lock.emplace();
+        } catch (const std::system_error& e) {
+            std::cerr << e.what() << std::endl;
+            return 1;
+        }
+
+    if (daemon) {
+        if (metrics_path.empty()) {
+            std::cerr << "the daemon needs a metrics file"sv << std::endl;
+            return 1;
+        }
+        if (! save_path.empty() || ! baseline_path.empty() || ! dump_path.empty() || ! heatmap_path.empty()
+                || freq_sweep || adaptive_ci > 0.0 || timeline_bucket.count() > 0) {
+            std::cerr << "the daemon runs every test once per round and only exports metrics"sv << std::endl;
+            return 1;
+        }
+        if (use_processes && perf_counters) {
+            std::cerr << "performance counters aren't supported for separate processes"sv << std::endl;
+            return 1;
+        }
+        if (daemon_modes.empty())
+            daemon_modes.push_back(mode);
+        for (auto daemon_mode : daemon_modes) {
+            if (! mode_is_two_sided(daemon_mode)) {
+                std::cerr << "the daemon runs two-sided tests only"sv << std::endl;
+                return 1;
+            }
+            if (daemon_mode != 0 && jitter_threshold) {
+                std::cerr << "interruptions are detected in mode 0 only"sv << std::endl;
+                return 1;
+            }
+            if (! provides_samples(daemon_mode, "exported"sv))
+                return 1;
+        }
+
+        std::vector<std::vector<unsigned short>> pairs;
+        if (! sweep_cpus.empty()) {
+            std::sort(sweep_cpus.begin(), sweep_cpus.end());
+            sweep_cpus.erase(std::unique(sweep_cpus.begin(), sweep_cpus.end()), sweep_cpus.end());
+            sort_by_topology(sweep_cpus);
+            for (auto first : sweep_cpus)
+                for (auto second : sweep_cpus)
+                    if (first != second)
+                        pairs.push_back({first, second});
+        } else if (cpuids_provided) {
+            cpu_list.resize(2);
+            pairs.push_back(cpu_list);
+        }
+        if (pairs.empty()) {
+            std::cerr << "the daemon needs a pair of cpu ids or a sweep list of at least two"sv << std::endl;
+            return 1;
+        }
+
+        std::vector<test_result> tests;
+        std::vector<unsigned short> all_cpus;
+        for (auto daemon_mode : daemon_modes)
+            for (const auto& pair : pairs) {
+                tests.push_back({daemon_mode, pair, attempts, {}});
+                all_cpus.insert(all_cpus.end(), pair.begin(), pair.end());
+            }
+        if (! preflight(all_cpus, preflight_check))
+            return 1;
+        return run_daemon(std::move(tests), request, daemon_interval, daemon_window, metrics_path);
+    }
+
+    // modes of a baseline are checked once it's loaded
+    if (mode != 0 && baseline_path.empty() && jitter_threshold) {
+        std::cerr << "interruptions are detected in mode 0 only"sv << std::endl;
+        return 1;
+    }
+
+    if (! mode_is_two_sided(mode)) {
+        if (use_processes) {
+            std::cerr << "separate processes are supported by two-sided tests only"sv << std::endl;
+            return 1;
+        }
+        if (adaptive_ci > 0.0 || timeline_bucket.count() > 0) {
+            std::cerr << "repeated runs are supported by two-sided tests only"sv << std::endl;
+            return 1;
+        }
+        if (! save_path.empty() || ! baseline_path.empty() || ! sweep_cpus.empty() || ! dump_path.empty() || freq_sweep) {
+            std::cerr << "results can be saved, compared, swept and dumped for two-sided tests only"sv << std::endl;
+            return 1;
+        }
+        if (! cpuids_provided) {
+            std::cerr << "some of cpu ids wasn't provided"sv << std::endl;
+            return 1;
+        }
+        // the test tells how many CPU cores it needs only once it's configured
+        try {
+            const auto count = workers_count(request);
+            if (cpu_list.size() < count) {
+                std::cerr << "the test needs "sv << count << " cpu ids but "sv << cpu_list.size() << " provided"sv
+                    << std::endl;
+                return 1;
+            }
+            cpu_list.resize(count);
+            if (! preflight(cpu_list, preflight_check))
+                return 1;
+            request.set_cpuids(std::move(cpu_list));
+            return measure(request).m_status;
+        } catch (const std::invalid_argument& e) {
+            std::cerr << e.what() << std::endl;
+            return 1;
+        } catch (const std::system_error& e) {
+            std::cerr << "unable to allocate test data: "sv << e.what() << std::endl;
+            return 1;
+        }
+    }
+
+    if (use_processes) {
+        if (perf_counters) {
+            std::cerr << "performance counters aren't supported for separate processes"sv << std::endl;
+            return 1;
+        }
+        if (adaptive_ci > 0.0 || timeline_bucket.count() > 0) {
+            std::cerr << "repeated runs aren't supported for separate processes"sv << std::endl;
+            return 1;
+        }
+    }
+
+    if (adaptive_ci > 0.0 && timeline_bucket.count() > 0) {
+        std::cerr << "a timeline can't be made with adaptive sampling"sv << std::endl;
+        return 1;
+    }
+
+    // raw samples are kept for the last run only
+    if (! dump_path.empty() && (! sweep_cpus.empty() || ! baseline_path.empty() || adaptive_ci > 0.0
+            || timeline_bucket.count() > 0)) {
+        std::cerr << "samples can be dumped for a single run of a test only"sv << std::endl;
+        return 1;
+    }
+
+    if (freq_sweep) {
+        if (! sweep_cpus.empty() || ! baseline_path.empty() || ! save_path.empty() || ! dump_path.empty()
+                || adaptive_ci > 0.0 || timeline_bucket.count() > 0) {
+            std::cerr << "a frequency sweep is made for a single run of a test only"sv << std::endl;
+            return 1;
+        }
+        if (! cpuids_provided) {
+            std::cerr << "some of cpu ids wasn't provided"sv << std::endl;
+            return 1;
+        }
+        if (! provides_samples(mode, "swept"sv))
+            return 1;
+        cpu_list.resize(2);
+        if (! preflight(cpu_list, preflight_check))
+            return 1;
+        return frequency_sweep(request, mode, cpu_list, freq_steps);
+    }
+
+    if (! heatmap_path.empty() && sweep_cpus.empty()) {
+        std::cerr << "heatmap is made by a sweep only"sv << std::endl;
+        return 1;
+    }
+
+    // the tests to run: the one given by the command line, the ones of the sweep or the ones
+    // saved in the baseline, their samples are added after they are run
+    std::vector<test_result> baseline;
+    std::vector<test_result> results;
+    if (! sweep_cpus.empty()) {
+        if (! baseline_path.empty()) {
+            std::cerr << "a sweep can't be run with a baseline, save the sweep and use it as a baseline"sv << std::endl;
+            return 1;
+        }
+        std::sort(sweep_cpus.begin(), sweep_cpus.end());
+        sweep_cpus.erase(std::unique(sweep_cpus.begin(), sweep_cpus.end()), sweep_cpus.end());
+        if (sweep_cpus.size() < 2) {
+            std::cerr << "a sweep needs at least two cpu ids"sv << std::endl;
+            return 1;
+        }
+        sort_by_topology(sweep_cpus);
+        for (auto first : sweep_cpus)
+            for (auto second : sweep_cpus)
+                if (first != second)
+                    results.push_back({mode, {first, second}, attempts, {}});
+        request.set_quiet(true);
+    } else if (! baseline_path.empty()) {
+        try {
+            baseline = load_results(baseline_path);
+        } catch (const std::runtime_error& e) {
+            std::cerr << "unable to load baseline: "sv << e.what() << std::endl;
+            return 1;
+        }
+        for (const auto& result : baseline) {
+            if (result.m_cpuids.size() != 2 || ! mode_is_two_sided(result.m_mode)) {
+                std::cerr << "baseline contains a result which isn't of a two-sided test"sv << std::endl;
+                return 1;
+            }
+            if (result.m_mode != 0 && jitter_threshold) {
+                std::cerr << "interruptions are detected in mode 0 only"sv << std::endl;
+                return 1;
+            }
+            results.push_back({result.m_mode, result.m_cpuids, result.m_attempts, {}});
+        }
+    } else {
+        if (! cpuids_provided) {
+            std::cerr << "some of cpu ids wasn't provided"sv << std::endl;
+            return 1;
+        }
+        cpu_list.resize(2);
+        results.push_back({mode, cpu_list, attempts, {}});
+    }
+
+    // found out before any test is run, not after the first one
+    if (! save_path.empty() || ! baseline.empty() || ! sweep_cpus.empty())
+        for (const auto& result : results)
+            if (! provides_samples(result.m_mode, "saved, compared or swept"sv))
+                return 1;
+
+    // the checks are made once for all the CPU cores the tests are run on
+    std::vector<unsigned short> all_cpus;
+    for (const auto& result : results)
+        all_cpus.insert(all_cpus.end(), result.m_cpuids.begin(), result.m_cpuids.end());
+    if (! preflight(all_cpus, preflight_check))
+        return 1;
+
+    bool regression = false;
+    for (std::size_t idx = 0; idx < results.size(); ++idx) {
+        auto& result = results[idx];
+        request.set_mode(result.m_mode);
+        request.set_cpuids(result.m_cpuids);
+        request.set_attempts(result.m_attempts);
+        request.set_dump_path(dump_path);
+
+        measurement_result res;
+        try {
+            res = measure(request);
+        } catch (const std::invalid_argument& e) {
+            std::cerr << e.what() << std::endl;
+            return 1;
+        } catch (const std::system_error& e) {
+            std::cerr << "unable to allocate test data: "sv << e.what() << std::endl;
+            return 1;
+        }
+        if (res.m_status != 0)
+            return res.m_status;
+
+        if (save_path.empty() && baseline.empty() && sweep_cpus.empty())
+            continue;
+        if (! res.m_samples) {
+            std::cerr << "mode "sv << result.m_mode << " doesn't provide samples to be saved, compared or swept"sv << std::endl;
+            return 1;
+        }
+        result.m_histogram = make_histogram(*res.m_samples);
+        if (! baseline.empty())
+            regression = compare_with_baseline(baseline[idx], result, regression_threshold) || regression;
+        if (! sweep_cpus.empty())
+            std::cout << "cpu "sv << result.m_cpuids[0] << " to cpu "sv << result.m_cpuids[1] << ": median "sv
+                << histogram_median(result.m_histogram) << " cycles"sv << std::endl;
+    }
+
+    if (! sweep_cpus.empty()) {
+        latency_matrix matrix{sweep_cpus, std::vector<double>(sweep_cpus.size() * sweep_cpus.size(), NAN)};
+        for (std::size_t idx = 0; idx < results.size(); ++idx) {
+            // pairs go row by row skipping the diagonal
+            const auto row = idx / (sweep_cpus.size() - 1);
+            auto column = idx % (sweep_cpus.size() - 1);
+            column += column >= row ? 1 : 0;
+            if (! results[idx].m_histogram.empty())
+                matrix.m_values[row * sweep_cpus.size() + column] = histogram_median(results[idx].m_histogram);
+        }
+
+        std::cout << "Median latency heatmap (rows: cpu of worker 1, columns: cpu of worker 2):"sv << std::endl;
+        print_heatmap(std::cout, matrix);
+        std::cout.flush();
+
+        if (! heatmap_path.empty())
+            try {
+                save_svg_heatmap(heatmap_path, matrix);
+            } catch (const std::runtime_error& e) {
+                std::cerr << "unable to save heatmap: "sv << e.what() << std::endl;
+                return 1;
+            }
+    }
+
+    if (! save_path.empty())
+        try {
+            save_results(save_path, results);
+        } catch (const std::runtime_error& e) {
+            std::cerr << "unable to save results: "sv << e.what() << std::endl;
+            return 1;
+        }
 
-    test_case->set_config(std::move(test_case_cfg));
-    return test_runner(cpuids[0], cpuids[1]).run(std::move(test_case));
+    return regression ? 2 : 0;
 }
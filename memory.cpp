@@ -0,0 +1,141 @@
+// vim: textwidth=100
+#include "memory.h"
+
+#include <cerrno>
+#include <climits>
+#include <string>
+#include <system_error>
+
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <linux/mempolicy.h>
+
+#ifndef MAP_HUGE_SHIFT
+#define MAP_HUGE_SHIFT 26
+#endif
+
+namespace {
+
+// libnuma isn't required for the calls below, so make them directly
+long mbind(void* addr, unsigned long len, int mode, const unsigned long* nodemask,
+        unsigned long maxnode, unsigned flags) {
+    return syscall(SYS_mbind, addr, len, mode, nodemask, maxnode, flags);
+}
+
+long get_mempolicy(int* mode, unsigned long* nodemask, unsigned long maxnode, const void* addr,
+        unsigned long flags) {
+    return syscall(SYS_get_mempolicy, mode, nodemask, maxnode, addr, flags);
+}
+
+std::size_t page_bytes(page_size pages) noexcept {
+    switch (pages) {
+    case page_size::huge_2m:
+        return std::size_t{1} << 21;
+    case page_size::huge_1g:
+        return std::size_t{1} << 30;
+    default:
+        return static_cast<std::size_t>(sysconf(_SC_PAGESIZE));
+    }
+}
+
+} // ns anonymous
+
+std::size_t mapping_size(std::size_t size, page_size pages) noexcept {
+    const auto page = page_bytes(pages);
+    return size == 0 ? page : (size + page - 1) / page * page;
+}
+
+void* map_memory(std::size_t size, const mapping_options& opts) {
+    constexpr int max_nodes = sizeof(unsigned long) * CHAR_BIT;
+
+    const auto page = page_bytes(opts.m_page_size);
+    size = mapping_size(size, opts.m_page_size);
+
+    int flags = (opts.m_shared ? MAP_SHARED : MAP_PRIVATE) | MAP_ANONYMOUS;
+    if (opts.m_page_size == page_size::huge_2m)
+        flags |= MAP_HUGETLB | (21 << MAP_HUGE_SHIFT);
+    else if (opts.m_page_size == page_size::huge_1g)
+        flags |= MAP_HUGETLB | (30 << MAP_HUGE_SHIFT);
+
+    auto addr = mmap(nullptr, size, PROT_READ | PROT_WRITE, flags, -1, 0);
+    if (addr == MAP_FAILED) {
+        auto err = errno;
+        throw std::system_error{err, std::system_category(), opts.m_page_size == page_size::normal
+            ? "unable to map memory"
+            : "unable to map memory on huge pages (are they reserved in /sys/kernel/mm/hugepages?)"};
+    }
+
+    if (opts.m_numa_node >= 0) {
+        if (opts.m_numa_node >= max_nodes) {
+            unmap_memory(addr, size, opts.m_page_size);
+            throw std::system_error{std::make_error_code(std::errc::invalid_argument),
+                "unsupported NUMA node"};
+        }
+
+        unsigned long nodemask = 1ul << opts.m_numa_node;
+        if (mbind(addr, size, MPOL_BIND, &nodemask, max_nodes + 1, MPOL_MF_STRICT | MPOL_MF_MOVE) != 0) {
+            auto err = errno;
+            unmap_memory(addr, size, opts.m_page_size);
+            throw std::system_error{err, std::system_category(), "unable to bind memory to NUMA node"};
+        }
+    }
+
+    // touch every page so it's allocated according to the policy right now and not in the middle
+    // of a test
+    for (std::size_t offset = 0; offset < size; offset += page)
+        static_cast<volatile char*>(addr)[offset] = 0;
+
+    if (opts.m_lock && mlock(addr, size) != 0) {
+        auto err = errno;
+        unmap_memory(addr, size, opts.m_page_size);
+        throw std::system_error{err, std::system_category(),
+            "unable to lock memory (is RLIMIT_MEMLOCK big enough?)"};
+    }
+
+    if (opts.m_numa_node >= 0)
+        if (auto node = memory_numa_node(addr); node != opts.m_numa_node) {
+            unmap_memory(addr, size, opts.m_page_size);
+            throw std::system_error{std::make_error_code(std::errc::invalid_argument),
+                "memory isn't placed on NUMA node " + std::to_string(opts.m_numa_node)};
+        }
+
+    return addr;
+}
+
+void unmap_memory(void* addr, std::size_t size, page_size pages) noexcept {
+    munmap(addr, mapping_size(size, pages));
+}
+
+int memory_numa_node(const void* addr) noexcept {
+    int node;
+    if (get_mempolicy(&node, nullptr, 0, addr, MPOL_F_NODE | MPOL_F_ADDR) != 0)
+        return -1;
+    return node;
+}
+
+memory_arena::memory_arena(std::size_t slots_count, const options& opts) : m_options(opts) {
+    if (m_options.m_slot_size < g_cache_line_size || (m_options.m_slot_size & (m_options.m_slot_size - 1)))
+        throw std::system_error{std::make_error_code(std::errc::invalid_argument),
+            "arena slot size must be a power of two not less than the cache line size"};
+
+    m_size = mapping_size(slots_count * m_options.m_slot_size, m_options.m_page_size);
+    m_begin = static_cast<std::byte*>(map_memory(m_size, m_options));
+}
+
+memory_arena& memory_arena::operator=(memory_arena&& other) noexcept {
+    if (this != &other) {
+        if (m_begin)
+            unmap_memory(m_begin, m_size, m_options.m_page_size);
+        m_begin = std::exchange(other.m_begin, nullptr);
+        m_size = std::exchange(other.m_size, 0);
+        m_used = std::exchange(other.m_used, 0);
+        m_options = other.m_options;
+    }
+    return *this;
+}
+
+memory_arena::~memory_arena() {
+    if (m_begin)
+        unmap_memory(m_begin, m_size, m_options.m_page_size);
+}
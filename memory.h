@@ -0,0 +1,155 @@
+// vim: textwidth=100
+#pragma once
+
+#include "common.h"
+
+#include <cstddef>
+#include <algorithm>
+#include <new>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+/*
+ * Memory for the data shared between workers. The memory is mapped directly from the kernel
+ * (not taken from the heap) so it's page aligned and its placement can be controlled.
+ */
+
+enum class page_size {
+    normal,
+    huge_2m,
+    huge_1g
+};
+
+struct mapping_options {
+    // NUMA node the memory is bound to, any node if it's negative
+    int m_numa_node = -1;
+    enum page_size m_page_size = page_size::normal;
+    // lock the memory in RAM so it's never swapped out
+    bool m_lock = false;
+    // share the memory with child processes instead of copying it on write
+    bool m_shared = false;
+};
+
+// size of the mapping which is really made for the requested size
+std::size_t mapping_size(std::size_t size, page_size pages) noexcept;
+
+// map zeroed memory according to the options, every page is touched before returning; throws
+// std::system_error on errors
+void* map_memory(std::size_t size, const mapping_options& opts = {});
+void unmap_memory(void* addr, std::size_t size, page_size pages = page_size::normal) noexcept;
+
+// NUMA node the memory page containing the address is placed on or -1 if it's unknown
+int memory_numa_node(const void* addr) noexcept;
+
+/*
+ * A memory region split into slots of the cache line size (or bigger, e.g. 128 bytes to keep
+ * data away from a pair of cache lines fetched together by the spatial prefetcher). Every object
+ * created in the arena occupies whole slots so it never shares them with other objects, and the
+ * layout doesn't depend on a compiler. Objects are never destroyed, only the memory is unmapped.
+ */
+class memory_arena {
+public:
+    struct options : mapping_options {
+        std::size_t m_slot_size = g_cache_line_size;
+    };
+
+private:
+    std::byte* m_begin = nullptr;
+    std::size_t m_size = 0;
+    std::size_t m_used = 0;
+    options m_options;
+
+public:
+    memory_arena() = default;
+    memory_arena(std::size_t slots_count, const options& opts);
+    memory_arena(memory_arena&& other) noexcept { *this = std::move(other); }
+    memory_arena& operator=(memory_arena&& other) noexcept;
+    ~memory_arena();
+
+    // number of slots the bytes occupy
+    static std::size_t slots(std::size_t size, const options& opts) noexcept {
+        return (size + opts.m_slot_size - 1) / opts.m_slot_size;
+    }
+
+    template <typename T, typename... Args>
+    T* create(Args&&... args) {
+        static_assert(std::is_trivially_destructible_v<T>, "objects in an arena are never destroyed");
+        static_assert(alignof(T) <= g_cache_line_size, "the object can't be aligned in an arena");
+
+        return new (allocate(slots(sizeof(T), m_options))) T(std::forward<Args>(args)...);
+    }
+
+    // objects of an array aren't separated by slots, the array as a whole occupies whole slots
+    template <typename T>
+    T* create_array(std::size_t count) {
+        static_assert(std::is_trivially_destructible_v<T>, "objects in an arena are never destroyed");
+        static_assert(alignof(T) <= g_cache_line_size, "the object can't be aligned in an arena");
+
+        auto res = static_cast<T*>(allocate(slots(sizeof(T) * count, m_options)));
+        for (std::size_t i = 0; i < count; ++i)
+            new (res + i) T();
+        return res;
+    }
+
+    int numa_node() const noexcept { return m_begin ? memory_numa_node(m_begin) : -1; }
+
+private:
+    void* allocate(std::size_t slots_count) {
+        const auto size = slots_count * m_options.m_slot_size;
+        if (m_used + size > m_size)
+            throw std::bad_alloc{};
+        return m_begin + std::exchange(m_used, m_used + size);
+    }
+};
+
+/*
+ * Allocator placing every allocation into its own memory mapping made according to the options,
+ * so buffers written during a test are already faulted in (and optionally locked) when the test
+ * starts and don't take page faults or TLB misses in the middle of it.
+ */
+template <typename T>
+class mapped_allocator {
+    mapping_options m_options;
+
+public:
+    using value_type = T;
+    using propagate_on_container_copy_assignment = std::true_type;
+    using propagate_on_container_move_assignment = std::true_type;
+    using propagate_on_container_swap = std::true_type;
+
+    mapped_allocator() = default;
+    explicit mapped_allocator(const mapping_options& opts) noexcept : m_options(opts) {}
+    template <typename U>
+    mapped_allocator(const mapped_allocator<U>& other) noexcept : m_options(other.options()) {}
+
+    T* allocate(std::size_t n) { return static_cast<T*>(map_memory(n * sizeof(T), m_options)); }
+    void deallocate(T* p, std::size_t n) noexcept { unmap_memory(p, n * sizeof(T), m_options.m_page_size); }
+
+    const mapping_options& options() const noexcept { return m_options; }
+
+    template <typename U>
+    bool operator==(const mapped_allocator<U>& other) const noexcept {
+        return m_options.m_numa_node == other.options().m_numa_node
+            && m_options.m_page_size == other.options().m_page_size
+            && m_options.m_lock == other.options().m_lock
+            && m_options.m_shared == other.options().m_shared;
+    }
+    template <typename U>
+    bool operator!=(const mapped_allocator<U>& other) const noexcept { return ! (*this == other); }
+};
+
+// a buffer for samples collected by a worker during a test
+template <typename T>
+using sample_buffer = std::vector<T, mapped_allocator<T>>;
+
+// (re)allocate the buffer having the specified number of value-initialized samples, the mapping
+// of a buffer of the same size and options is reused, so repeated runs of a test don't map and
+// unmap (possibly huge) pages every time
+template <typename T>
+void allocate_samples(sample_buffer<T>& buffer, std::size_t size, const mapping_options& opts) {
+    if (buffer.size() == size && buffer.get_allocator() == mapped_allocator<T>{opts})
+        std::fill(buffer.begin(), buffer.end(), T{});
+    else
+        buffer = sample_buffer<T>(size, mapped_allocator<T>{opts});
+}
@@ -0,0 +1,69 @@
+// vim: textwidth=100
+#include "metrics.h"
+#include "cachelineperf.h"
+
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <limits>
+#include <stdexcept>
+#include <utility>
+
+namespace {
+
+// quantiles with their labels, which aren't subject to the precision of values
+constexpr std::pair<double, const char*> g_quantiles[] = {{0.5, "0.5"}, {0.9, "0.9"}, {0.99, "0.99"}, {0.999, "0.999"}};
+
+void write_labels(std::ostream& os, const test_result& result) {
+    os << "mode=\"" << result.m_mode << "\",test=\"" << mode_name(result.m_mode) << "\"";
+    for (std::size_t i = 0; i < result.m_cpuids.size(); ++i)
+        os << ",cpu" << i + 1 << "=\"" << result.m_cpuids[i] << "\"";
+}
+
+} // ns anonymous
+
+void write_metrics(const std::string& path, const std::vector<test_result>& results, double tsc_ghz,
+        std::uint64_t rounds) {
+    const auto tmp_path = path + ".tmp";
+    std::ofstream os{tmp_path};
+    if (! os)
+        throw std::runtime_error{"unable to open " + tmp_path};
+
+    os.precision(std::numeric_limits<double>::max_digits10);
+    os << "# HELP cacheline_latency_cycles Cache line hand-off latency in TSC cycles.\n"
+        "# TYPE cacheline_latency_cycles summary\n";
+    for (const auto& result : results) {
+        double sum = 0.0;
+        std::uint64_t count = 0;
+        for (const auto& [value, bin_count] : result.m_histogram) {
+            sum += value * static_cast<double>(bin_count);
+            count += bin_count;
+        }
+        if (count == 0)
+            continue;
+
+        for (const auto& [q, label] : g_quantiles) {
+            os << "cacheline_latency_cycles{";
+            write_labels(os, result);
+            os << ",quantile=\"" << label << "\"} " << histogram_quantile(result.m_histogram, q) << "\n";
+        }
+        os << "cacheline_latency_cycles_sum{";
+        write_labels(os, result);
+        os << "} " << sum << "\ncacheline_latency_cycles_count{";
+        write_labels(os, result);
+        os << "} " << count << "\n";
+    }
+    os << "# HELP cacheline_tsc_hertz Rate of the time stamp counter latency is measured by.\n"
+        "# TYPE cacheline_tsc_hertz gauge\n"
+        "cacheline_tsc_hertz " << tsc_ghz * 1e9 << "\n"
+        "# HELP cacheline_rounds_total Rounds of tests run.\n"
+        "# TYPE cacheline_rounds_total counter\n"
+        "cacheline_rounds_total " << rounds << "\n";
+
+    if (! os.flush())
+        throw std::runtime_error{"unable to write " + tmp_path};
+    os.close();
+    if (std::rename(tmp_path.c_str(), path.c_str()) != 0)
+        throw std::runtime_error{"unable to rename " + tmp_path + " to " + path + ": " + std::strerror(errno)};
+}
@@ -0,0 +1,22 @@
+// vim: textwidth=100
+#pragma once
+
+#include "results.h"
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+/*
+ * Results of tests exported as metrics in the Prometheus text format to be picked up by the node
+ * exporter's textfile collector or a similar agent. Latency of every test is a summary labeled
+ * with the mode and the CPU cores:
+ *
+ *   cacheline_latency_cycles{mode="0",test="one side test",cpu1="0",cpu2="1",quantile="0.5"} 58
+ *
+ * The file is written under a temporary name and renamed, so readers never see a partial one.
+ */
+
+// throws std::runtime_error if the file can't be written
+void write_metrics(const std::string& path, const std::vector<test_result>& results, double tsc_ghz,
+    std::uint64_t rounds);
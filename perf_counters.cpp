@@ -0,0 +1,119 @@
+// vim: textwidth=100
+#include "perf_counters.h"
+
+#include <cerrno>
+#include <cstring>
+#include <sstream>
+
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+namespace {
+
+struct event {
+    const char* m_name;
+    std::uint32_t m_type;
+    std::uint64_t m_config;
+};
+
+constexpr std::uint64_t cache_event(std::uint64_t cache, std::uint64_t op, std::uint64_t result) {
+    return cache | (op << 8) | (result << 16);
+}
+
+const event g_hardware_events[] = {
+    {"cycles", PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES},
+    {"instructions", PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS},
+    {"L1D read misses", PERF_TYPE_HW_CACHE,
+        cache_event(PERF_COUNT_HW_CACHE_L1D, PERF_COUNT_HW_CACHE_OP_READ, PERF_COUNT_HW_CACHE_RESULT_MISS)},
+    {"LLC read misses", PERF_TYPE_HW_CACHE,
+        cache_event(PERF_COUNT_HW_CACHE_LL, PERF_COUNT_HW_CACHE_OP_READ, PERF_COUNT_HW_CACHE_RESULT_MISS)},
+    {"remote node reads", PERF_TYPE_HW_CACHE,
+        cache_event(PERF_COUNT_HW_CACHE_NODE, PERF_COUNT_HW_CACHE_OP_READ, PERF_COUNT_HW_CACHE_RESULT_MISS)}
+};
+
+const event g_software_events[] = {
+    {"task clock, ns", PERF_TYPE_SOFTWARE, PERF_COUNT_SW_TASK_CLOCK},
+    {"context switches", PERF_TYPE_SOFTWARE, PERF_COUNT_SW_CONTEXT_SWITCHES},
+    {"cpu migrations", PERF_TYPE_SOFTWARE, PERF_COUNT_SW_CPU_MIGRATIONS},
+    {"page faults", PERF_TYPE_SOFTWARE, PERF_COUNT_SW_PAGE_FAULTS}
+};
+
+int open_event(std::uint32_t type, std::uint64_t config) {
+    perf_event_attr attr;
+    std::memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = type;
+    attr.config = config;
+    attr.disabled = 1;
+    attr.exclude_hv = 1;
+    attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+
+    // count the kernel side too if it's allowed, it's where interrupts are handled
+    auto fd = static_cast<int>(syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0));
+    if (fd < 0 && (errno == EACCES || errno == EPERM)) {
+        attr.exclude_kernel = 1;
+        fd = static_cast<int>(syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0));
+    }
+    return fd;
+}
+
+} // ns anonymous
+
+perf_counters::perf_counters(const std::vector<std::uint64_t>& raw_events) {
+    for (const auto& e : g_hardware_events)
+        if (auto fd = open_event(e.m_type, e.m_config); fd >= 0)
+            m_counters.push_back({e.m_name, fd});
+        else if (m_counters.empty()) {
+            // there are no cycles, so there is no PMU
+            m_hardware = false;
+            break;
+        }
+
+    if (m_hardware)
+        for (auto raw_event : raw_events)
+            if (auto fd = open_event(PERF_TYPE_RAW, raw_event); fd >= 0) {
+                std::ostringstream name;
+                name << "raw 0x" << std::hex << raw_event;
+                m_counters.push_back({name.str(), fd});
+            }
+
+    if (! m_hardware)
+        for (const auto& e : g_software_events)
+            if (auto fd = open_event(e.m_type, e.m_config); fd >= 0)
+                m_counters.push_back({e.m_name, fd});
+}
+
+perf_counters::~perf_counters() {
+    for (auto& c : m_counters)
+        close(c.m_fd);
+}
+
+void perf_counters::start() noexcept {
+    for (auto& c : m_counters) {
+        ioctl(c.m_fd, PERF_EVENT_IOC_RESET, 0);
+        ioctl(c.m_fd, PERF_EVENT_IOC_ENABLE, 0);
+    }
+}
+
+void perf_counters::stop() noexcept {
+    for (auto& c : m_counters)
+        ioctl(c.m_fd, PERF_EVENT_IOC_DISABLE, 0);
+}
+
+std::vector<perf_counters::value> perf_counters::read() const {
+    std::vector<value> res;
+
+    for (auto& c : m_counters) {
+        // value, time enabled, time running
+        std::uint64_t data[3];
+        if (::read(c.m_fd, data, sizeof(data)) != sizeof(data))
+            continue;
+        if (data[2] != 0 && data[2] < data[1])
+            data[0] = static_cast<std::uint64_t>(static_cast<double>(data[0]) * data[1] / data[2]);
+        res.push_back({c.m_name, data[0]});
+    }
+
+    return res;
+}
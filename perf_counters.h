@@ -0,0 +1,42 @@
+// vim: textwidth=100
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+/*
+ * Performance counters of the calling thread which are read around the main part of a worker.
+ * Hardware events are counted if the PMU is available: cycles, instructions, L1D and LLC read
+ * misses, reads served by a remote NUMA node and model specific raw events (e.g. HITM snoops)
+ * given by their codes. Otherwise (e.g. in a virtual machine without PMU passed through) software
+ * events are counted. Events which can't be opened are skipped.
+ */
+class perf_counters {
+public:
+    struct value {
+        std::string m_name;
+        std::uint64_t m_value;
+    };
+
+private:
+    struct counter {
+        std::string m_name;
+        int m_fd;
+    };
+
+    std::vector<counter> m_counters;
+    bool m_hardware = true;
+
+public:
+    explicit perf_counters(const std::vector<std::uint64_t>& raw_events);
+    perf_counters(const perf_counters&) = delete;
+    ~perf_counters();
+
+    void start() noexcept;
+    void stop() noexcept;
+    // values scaled if events were multiplexed
+    std::vector<value> read() const;
+
+    bool hardware() const noexcept { return m_hardware; }
+};
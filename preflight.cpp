@@ -0,0 +1,126 @@
+// vim: textwidth=100
+#include "preflight.h"
+#include "topology.h"
+
+#include <cctype>
+#include <cstdlib>
+#include <algorithm>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+#include <string_view>
+
+#include <dirent.h>
+
+namespace {
+
+// deeper C-states take longer to exit than this
+constexpr long g_max_exit_latency_us = 2;
+
+std::string read_line(const std::string& path) {
+    std::ifstream is{path};
+    std::string res;
+    std::getline(is, res);
+    return res;
+}
+
+// CPU list of a kernel command line parameter; isolcpus may contain flags before the list
+std::vector<unsigned> cmdline_cpu_list(const std::string& cmdline, std::string_view param) {
+    std::istringstream is{cmdline};
+    std::string token;
+    while (is >> token) {
+        if (token.size() <= param.size() || token.compare(0, param.size(), param) != 0
+                || token[param.size()] != '=')
+            continue;
+
+        std::string list;
+        std::istringstream items{token.substr(param.size() + 1)};
+        std::string item;
+        while (std::getline(items, item, ','))
+            if (! item.empty() && std::isdigit(static_cast<unsigned char>(item[0])))
+                list += (list.empty() ? "" : ",") + item;
+
+        try {
+            return parse_cpu_list(list);
+        } catch (const std::invalid_argument&) {
+            return {};
+        }
+    }
+    return {};
+}
+
+void check_cmdline(const std::vector<unsigned short>& cpuids, std::vector<std::string>& issues) {
+    const auto cmdline = read_line("/proc/cmdline");
+
+    for (auto param : {"isolcpus", "nohz_full", "rcu_nocbs"}) {
+        const auto list = cmdline_cpu_list(cmdline, param);
+        for (auto cpuid : cpuids)
+            if (std::find(list.begin(), list.end(), cpuid) == list.end())
+                issues.push_back("cpu " + std::to_string(cpuid) + " isn't listed in " + param
+                    + " kernel parameter");
+    }
+}
+
+void check_irqs(const std::vector<unsigned short>& cpuids, std::vector<std::string>& issues) {
+    std::vector<std::string> irqs(cpuids.size());
+
+    auto dir = opendir("/proc/irq");
+    if (! dir)
+        return;
+
+    while (auto entry = readdir(dir)) {
+        char* end;
+        std::strtol(entry->d_name, &end, 10);
+        if (end == entry->d_name || *end != '\0')
+            continue;
+
+        std::vector<unsigned> list;
+        try {
+            list = parse_cpu_list(read_line(std::string{"/proc/irq/"} + entry->d_name + "/smp_affinity_list"));
+        } catch (const std::invalid_argument&) {
+            continue;
+        }
+
+        for (std::size_t i = 0; i < cpuids.size(); ++i)
+            if (std::find(list.begin(), list.end(), cpuids[i]) != list.end())
+                irqs[i] += (irqs[i].empty() ? "" : ", ") + std::string{entry->d_name};
+    }
+    closedir(dir);
+
+    for (std::size_t i = 0; i < cpuids.size(); ++i)
+        if (! irqs[i].empty())
+            issues.push_back("cpu " + std::to_string(cpuids[i]) + " may handle IRQs " + irqs[i]);
+}
+
+void check_power_management(const std::vector<unsigned short>& cpuids, std::vector<std::string>& issues) {
+    for (auto cpuid : cpuids) {
+        const auto cpu_path = "/sys/devices/system/cpu/cpu" + std::to_string(cpuid);
+
+        if (auto governor = read_line(cpu_path + "/cpufreq/scaling_governor");
+                ! governor.empty() && governor != "performance")
+            issues.push_back("cpu " + std::to_string(cpuid) + " has \"" + governor
+                + "\" cpufreq governor instead of \"performance\"");
+
+        for (unsigned state = 0;; ++state) {
+            const auto state_path = cpu_path + "/cpuidle/state" + std::to_string(state);
+            const auto latency = read_line(state_path + "/latency");
+            if (latency.empty())
+                break;
+            if (std::atol(latency.c_str()) > g_max_exit_latency_us && read_line(state_path + "/disable") == "0")
+                issues.push_back("cpu " + std::to_string(cpuid) + " may enter C-state "
+                    + read_line(state_path + "/name") + " with exit latency " + latency + "us");
+        }
+    }
+}
+
+} // ns anonymous
+
+std::vector<std::string> check_isolation(const std::vector<unsigned short>& cpuids) {
+    std::vector<std::string> issues;
+
+    check_cmdline(cpuids, issues);
+    check_irqs(cpuids, issues);
+    check_power_management(cpuids, issues);
+
+    return issues;
+}
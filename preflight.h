@@ -0,0 +1,14 @@
+// vim: textwidth=100
+#pragma once
+
+#include <string>
+#include <vector>
+
+/*
+ * Checks whether the system is configured to run tests on the specified CPU cores without
+ * interference: the cores are isolated from the scheduler (isolcpus), scheduler ticks (nohz_full)
+ * and RCU callbacks (rcu_nocbs), no IRQ is allowed to be handled on them, the cpufreq governor
+ * doesn't change their frequency and deep C-states are disabled. Returns a description of every
+ * problem found, an empty list means the cores look isolated.
+ */
+std::vector<std::string> check_isolation(const std::vector<unsigned short>& cpuids);
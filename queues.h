@@ -0,0 +1,137 @@
+// vim: textwidth=100
+#pragma once
+
+#include "common.h"
+
+#include <cstddef>
+#include <atomic>
+#include <memory>
+
+/*
+ * Queues used by the MPMC contention tests. They are intentionally simple and mimic what a typical
+ * work queue of a service looks like, so the test shows the cost of cache lines movement caused
+ * by the queue's own bookkeeping.
+ */
+
+/*
+ * Bounded array queue where every slot has its own sequence number (D. Vyukov's design).
+ * Producers and consumers contend only on the enqueue and dequeue positions correspondingly,
+ * a slot is handed over from a producer to a consumer through its sequence number.
+ */
+template <typename T>
+class bounded_mpmc_queue {
+    struct alignas(g_cache_line_size) cell {
+        std::atomic<std::size_t> m_sequence;
+        T m_data;
+    };
+
+    std::unique_ptr<cell[]> m_cells;
+    const std::size_t m_mask;
+    alignas(g_cache_line_size) std::atomic<std::size_t> m_enqueue_pos{0};
+    alignas(g_cache_line_size) std::atomic<std::size_t> m_dequeue_pos{0};
+
+public:
+    // capacity must be a power of two
+    explicit bounded_mpmc_queue(std::size_t capacity)
+        : m_cells{new cell[capacity]}, m_mask{capacity - 1} {
+        for (std::size_t i = 0; i < capacity; ++i)
+            m_cells[i].m_sequence.store(i, std::memory_order_relaxed);
+    }
+
+    bool try_push(const T& data) noexcept {
+        cell* c;
+        auto pos = m_enqueue_pos.load(std::memory_order_relaxed);
+        while (true) {
+            c = &m_cells[pos & m_mask];
+            auto seq = c->m_sequence.load(std::memory_order_acquire);
+            auto diff = static_cast<std::ptrdiff_t>(seq) - static_cast<std::ptrdiff_t>(pos);
+            if (diff == 0) {
+                if (m_enqueue_pos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+                    break;
+            } else if (diff < 0)
+                return false;
+            else
+                pos = m_enqueue_pos.load(std::memory_order_relaxed);
+        }
+        c->m_data = data;
+        c->m_sequence.store(pos + 1, std::memory_order_release);
+        return true;
+    }
+
+    bool try_pop(T& data) noexcept {
+        cell* c;
+        auto pos = m_dequeue_pos.load(std::memory_order_relaxed);
+        while (true) {
+            c = &m_cells[pos & m_mask];
+            auto seq = c->m_sequence.load(std::memory_order_acquire);
+            auto diff = static_cast<std::ptrdiff_t>(seq) - static_cast<std::ptrdiff_t>(pos + 1);
+            if (diff == 0) {
+                if (m_dequeue_pos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+                    break;
+            } else if (diff < 0)
+                return false;
+            else
+                pos = m_dequeue_pos.load(std::memory_order_relaxed);
+        }
+        data = c->m_data;
+        c->m_sequence.store(pos + m_mask + 1, std::memory_order_release);
+        return true;
+    }
+};
+
+/*
+ * Linked list queue with separate head and tail spin locks (M. Michael and M. Scott two-lock
+ * queue). Nodes are taken from a preallocated pool and never reused during a test, so there is
+ * neither memory allocation nor reclamation in the measured path.
+ */
+template <typename T>
+class list_mpmc_queue {
+public:
+    struct alignas(g_cache_line_size) node {
+        std::atomic<node*> m_next{nullptr};
+        T m_data;
+    };
+
+private:
+    class spin_lock {
+        std::atomic<bool> m_locked{false};
+    public:
+        void lock() noexcept {
+            while (m_locked.exchange(true, std::memory_order_acquire))
+                while (m_locked.load(std::memory_order_relaxed))
+                    ;
+        }
+        void unlock() noexcept { m_locked.store(false, std::memory_order_release); }
+    };
+
+    node m_dummy;
+    alignas(g_cache_line_size) spin_lock m_head_lock;
+    node* m_head = &m_dummy;
+    alignas(g_cache_line_size) spin_lock m_tail_lock;
+    node* m_tail = &m_dummy;
+
+public:
+    explicit list_mpmc_queue(std::size_t) {}
+
+    // a caller owns the node until it's dequeued by somebody
+    void push(node* n) noexcept {
+        n->m_next.store(nullptr, std::memory_order_relaxed);
+        m_tail_lock.lock();
+        m_tail->m_next.store(n, std::memory_order_release);
+        m_tail = n;
+        m_tail_lock.unlock();
+    }
+
+    bool try_pop(T& data) noexcept {
+        m_head_lock.lock();
+        auto next = m_head->m_next.load(std::memory_order_acquire);
+        if (! next) {
+            m_head_lock.unlock();
+            return false;
+        }
+        data = next->m_data;
+        m_head = next;
+        m_head_lock.unlock();
+        return true;
+    }
+};
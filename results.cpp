@@ -0,0 +1,228 @@
+// vim: textwidth=100
+#include "results.h"
+
+#include <cctype>
+#include <fstream>
+#include <iterator>
+#include <limits>
+#include <sstream>
+#include <stdexcept>
+#include <string_view>
+
+namespace {
+
+constexpr int g_version = 1;
+
+/*
+ * A reader of the subset of JSON the results are written in: objects, arrays, strings without
+ * escapes and numbers. Unknown members of objects are skipped.
+ */
+class json_reader {
+    std::string_view m_text;
+    std::size_t m_pos = 0;
+
+public:
+    explicit json_reader(std::string_view text) : m_text(text) {}
+
+    [[noreturn]] void fail(std::string_view what) const {
+        std::ostringstream os;
+        os << what << " at offset " << m_pos;
+        throw std::runtime_error{os.str()};
+    }
+
+    void skip_spaces() {
+        while (m_pos < m_text.size() && std::isspace(static_cast<unsigned char>(m_text[m_pos])))
+            ++m_pos;
+    }
+
+    char peek() {
+        skip_spaces();
+        return m_pos < m_text.size() ? m_text[m_pos] : '\0';
+    }
+
+    void expect(char c) {
+        if (peek() != c)
+            fail(std::string{"expected '"} + c + "'");
+        ++m_pos;
+    }
+
+    bool at_end() {
+        return peek() == '\0';
+    }
+
+    std::string read_string() {
+        expect('"');
+        auto end = m_text.find('"', m_pos);
+        if (end == std::string_view::npos)
+            fail("unterminated string");
+        std::string res{m_text.substr(m_pos, end - m_pos)};
+        m_pos = end + 1;
+        return res;
+    }
+
+    double read_number() {
+        skip_spaces();
+        std::size_t end = m_pos;
+        while (end < m_text.size() && (std::isdigit(static_cast<unsigned char>(m_text[end]))
+                || std::string_view{"+-.eE"}.find(m_text[end]) != std::string_view::npos))
+            ++end;
+        std::istringstream is{std::string{m_text.substr(m_pos, end - m_pos)}};
+        double res;
+        is >> res;
+        if (end == m_pos || is.fail() || ! is.eof())
+            fail("malformed number");
+        m_pos = end;
+        return res;
+    }
+
+    template <typename T>
+    T read_integer() {
+        const auto value = read_number();
+        // the maximum of a 64-bit type is rounded up to 2^64 as a double, so the bound is open
+        if (! (value >= 0 && value < static_cast<double>(std::numeric_limits<T>::max()) + 1.0)
+                || value != static_cast<double>(static_cast<T>(value)))
+            fail("unacceptable integer");
+        return static_cast<T>(value);
+    }
+
+    // call read_item() for every item of an array
+    template <typename ReadItem>
+    void read_array(ReadItem&& read_item) {
+        expect('[');
+        if (peek() == ']') {
+            ++m_pos;
+            return;
+        }
+        while (true) {
+            read_item();
+            if (peek() != ',')
+                break;
+            ++m_pos;
+        }
+        expect(']');
+    }
+
+    // call read_member(name) for every member of an object, it returns false if the member
+    // is unknown and should be skipped
+    template <typename ReadMember>
+    void read_object(ReadMember&& read_member) {
+        expect('{');
+        if (peek() == '}') {
+            ++m_pos;
+            return;
+        }
+        while (true) {
+            auto name = read_string();
+            expect(':');
+            if (! read_member(name))
+                skip_value();
+            if (peek() != ',')
+                break;
+            ++m_pos;
+        }
+        expect('}');
+    }
+
+    void skip_value() {
+        switch (peek()) {
+        case '{':
+            read_object([](const std::string&){ return false; });
+            break;
+        case '[':
+            read_array([this](){ skip_value(); });
+            break;
+        case '"':
+            read_string();
+            break;
+        default:
+            read_number();
+        }
+    }
+};
+
+test_result read_result(json_reader& reader) {
+    test_result res;
+    reader.read_object([&](const std::string& name){
+        if (name == "mode")
+            res.m_mode = reader.read_integer<unsigned>();
+        else if (name == "cpuids")
+            reader.read_array([&](){ res.m_cpuids.push_back(reader.read_integer<unsigned short>()); });
+        else if (name == "attempts")
+            res.m_attempts = reader.read_integer<std::uint32_t>();
+        else if (name == "histogram")
+            reader.read_array([&](){
+                std::pair<double, std::uint64_t> bin;
+                std::size_t items = 0;
+                reader.read_array([&](){
+                    if (items == 0)
+                        bin.first = reader.read_number();
+                    else if (items == 1)
+                        bin.second = reader.read_integer<std::uint64_t>();
+                    else
+                        reader.fail("too many items in a histogram bin");
+                    ++items;
+                });
+                if (items != 2)
+                    reader.fail("too few items in a histogram bin");
+                // comparisons and merging of histograms rely on their bins being sorted
+                if (! res.m_histogram.empty() && ! (res.m_histogram.back().first < bin.first))
+                    reader.fail("histogram bins aren't sorted by value or duplicated");
+                res.m_histogram.push_back(bin);
+            });
+        else
+            return false;
+        return true;
+    });
+    return res;
+}
+
+} // ns anonymous
+
+void save_results(const std::string& path, const std::vector<test_result>& results) {
+    std::ofstream os{path};
+    if (! os)
+        throw std::runtime_error{"unable to open " + path};
+
+    os.precision(std::numeric_limits<double>::max_digits10);
+    os << "{\"version\": " << g_version << ", \"results\": [";
+    for (std::size_t i = 0; i < results.size(); ++i) {
+        const auto& result = results[i];
+        os << (i ? "," : "") << "\n  {\"mode\": " << result.m_mode << ", \"cpuids\": [";
+        for (std::size_t j = 0; j < result.m_cpuids.size(); ++j)
+            os << (j ? ", " : "") << result.m_cpuids[j];
+        os << "], \"attempts\": " << result.m_attempts << ", \"histogram\": [";
+        for (std::size_t j = 0; j < result.m_histogram.size(); ++j)
+            os << (j ? ", " : "") << "[" << result.m_histogram[j].first << ", " << result.m_histogram[j].second << "]";
+        os << "]}";
+    }
+    os << "\n]}\n";
+
+    if (! os.flush())
+        throw std::runtime_error{"unable to write " + path};
+}
+
+std::vector<test_result> load_results(const std::string& path) {
+    std::ifstream is{path};
+    if (! is)
+        throw std::runtime_error{"unable to open " + path};
+    const std::string text{std::istreambuf_iterator<char>{is}, std::istreambuf_iterator<char>{}};
+
+    std::vector<test_result> res;
+    json_reader reader{text};
+    int version = -1;
+    reader.read_object([&](const std::string& name){
+        if (name == "version")
+            version = reader.read_integer<int>();
+        else if (name == "results")
+            reader.read_array([&](){ res.push_back(read_result(reader)); });
+        else
+            return false;
+        return true;
+    });
+    if (! reader.at_end())
+        reader.fail("unexpected data");
+    if (version != g_version)
+        throw std::runtime_error{"unsupported version of results in " + path};
+
+    return res;
+}
@@ -0,0 +1,28 @@
+// vim: textwidth=100
+#pragma once
+
+#include "stats.h"
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+/*
+ * Results of tests saved to a JSON file to be compared with later runs, e.g. after a kernel or
+ * BIOS update. Only the data needed to repeat a test and compare its samples is kept:
+ *
+ *   {"version": 1, "results": [
+ *     {"mode": 0, "cpuids": [0, 1], "attempts": 1000, "histogram": [[58, 120], [59, 3]]}
+ *   ]}
+ */
+struct test_result {
+    unsigned m_mode = 0;
+    std::vector<unsigned short> m_cpuids;
+    std::uint32_t m_attempts = 0;
+    // the samples in cycles
+    histogram m_histogram;
+};
+
+// both throw std::runtime_error if the file can't be written or read or it's malformed
+void save_results(const std::string& path, const std::vector<test_result>& results);
+std::vector<test_result> load_results(const std::string& path);
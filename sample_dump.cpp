@@ -0,0 +1,121 @@
+// vim: textwidth=100
+#include "sample_dump.h"
+
+#include <cerrno>
+#include <cstring>
+#include <algorithm>
+#include <iterator>
+#include <new>
+#include <stdexcept>
+#include <system_error>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace {
+
+std::system_error last_error(const std::string& what) {
+    return std::system_error{errno, std::generic_category(), what};
+}
+
+std::size_t words_per_sample(sample_dump_header::kind kind) {
+    return kind == sample_dump_header::kind::cycle_pairs ? 2 : 1;
+}
+
+} // ns anonymous
+
+void write_sample_dump(const std::string& path, const std::string& test_name,
+        unsigned short first_cpuid, unsigned short second_cpuid, double tsc_ghz, const raw_samples& samples) {
+    const auto size = sizeof(sample_dump_header)
+        + samples.m_count * words_per_sample(samples.m_kind) * sizeof(std::uint64_t);
+
+    const int fd = open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0)
+        throw last_error("unable to open " + path);
+    // the blocks are allocated up front, a sparse file would make writing through the mapping
+    // kill the process by SIGBUS if the disk is full
+    if (const int res = posix_fallocate(fd, 0, static_cast<off_t>(size)); res != 0) {
+        close(fd);
+        throw std::system_error{res, std::generic_category(), "unable to allocate space for " + path};
+    }
+    auto addr = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (addr == MAP_FAILED)
+        throw last_error("unable to map " + path);
+
+    auto header = new (addr) sample_dump_header{};
+    std::memcpy(header->m_magic, sample_dump_header::s_magic, sizeof(header->m_magic));
+    header->m_version = sample_dump_header::s_version;
+    header->m_kind = samples.m_kind;
+    header->m_cpuids[0] = first_cpuid;
+    header->m_cpuids[1] = second_cpuid;
+    header->m_handoffs = samples.m_handoffs;
+    header->m_tsc_ghz = tsc_ghz;
+    header->m_count = samples.m_count;
+    test_name.copy(header->m_test_name, sizeof(header->m_test_name) - 1);
+
+    auto data = reinterpret_cast<std::uint64_t*>(header + 1);
+    if (samples.m_kind == sample_dump_header::kind::cycle_pairs)
+        for (std::size_t i = 0; i < samples.m_count; ++i) {
+            *data++ = samples.m_first[i];
+            *data++ = samples.m_second[i];
+        }
+    else
+        std::copy(samples.m_first, samples.m_first + samples.m_count, data);
+
+    // the kernel writes the pages back, msync() would only make us wait for it
+    munmap(addr, size);
+}
+
+sample_dump::sample_dump(const std::string& path) {
+    const int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0)
+        throw last_error("unable to open " + path);
+
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+        auto err = last_error("unable to get size of " + path);
+        close(fd);
+        throw err;
+    }
+    m_size = static_cast<std::size_t>(st.st_size);
+    if (m_size < sizeof(sample_dump_header)) {
+        close(fd);
+        throw std::runtime_error{path + " is too short to be a sample dump"};
+    }
+
+    m_addr = mmap(nullptr, m_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (m_addr == MAP_FAILED)
+        throw last_error("unable to map " + path);
+    // samples are read once in order
+    madvise(m_addr, m_size, MADV_SEQUENTIAL);
+
+    const auto& hdr = header();
+    const char* problem = nullptr;
+    if (std::memcmp(hdr.m_magic, sample_dump_header::s_magic, sizeof(hdr.m_magic)) != 0)
+        problem = " isn't a sample dump";
+    else if (hdr.m_version != sample_dump_header::s_version)
+        problem = " has unsupported version";
+    else if (hdr.m_kind != sample_dump_header::kind::cycle_pairs && hdr.m_kind != sample_dump_header::kind::cycles)
+        problem = " has unknown kind of samples";
+    else if (hdr.m_handoffs == 0)
+        problem = " has no hand-offs per sample";
+    else if (! (hdr.m_tsc_ghz > 0.0))
+        problem = " has invalid TSC frequency";
+    else if ((m_size - sizeof(sample_dump_header)) / sizeof(std::uint64_t) / words_per_sample(hdr.m_kind) < hdr.m_count)
+        problem = " is truncated";
+    else if (std::find(hdr.m_test_name, std::end(hdr.m_test_name), '\0') == std::end(hdr.m_test_name))
+        problem = " has malformed test name";
+
+    if (problem) {
+        munmap(m_addr, m_size);
+        throw std::runtime_error{path + problem};
+    }
+}
+
+sample_dump::~sample_dump() {
+    munmap(m_addr, m_size);
+}
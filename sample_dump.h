@@ -0,0 +1,74 @@
+// vim: textwidth=100
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+/*
+ * A binary file of raw samples for offline analysis: the header followed by the samples as 64-bit
+ * words in the native byte order. Samples are either pairs of start and end cycles of an attempt
+ * (an attempt which isn't finished has zero end cycles) or cycles of an attempt consisting of
+ * several hand-offs. Files are written and read through memory mappings, so multi-GB sample sets
+ * don't go through stream buffers.
+ */
+struct sample_dump_header {
+    static constexpr char s_magic[8] = {'C', 'L', 'M', 'V', 'D', 'U', 'M', 'P'};
+    static constexpr std::uint32_t s_version = 1;
+
+    enum class kind : std::uint32_t {
+        cycle_pairs,
+        cycles
+    };
+
+    char m_magic[8];
+    std::uint32_t m_version;
+    kind m_kind;
+    std::uint32_t m_cpuids[2];
+    // hand-offs every sample consists of
+    std::uint32_t m_handoffs;
+    std::uint32_t m_reserved;
+    double m_tsc_ghz;
+    // number of samples (pairs for cycle_pairs)
+    std::uint64_t m_count;
+    // zero terminated
+    char m_test_name[64];
+};
+
+static_assert(sizeof(sample_dump_header) % sizeof(std::uint64_t) == 0);
+
+// a view of raw samples kept by a test case, the second array is present for pairs only
+struct raw_samples {
+    sample_dump_header::kind m_kind = sample_dump_header::kind::cycles;
+    const std::uint64_t* m_first = nullptr;
+    const std::uint64_t* m_second = nullptr;
+    std::size_t m_count = 0;
+    std::uint32_t m_handoffs = 1;
+};
+
+// throws std::system_error on failure
+void write_sample_dump(const std::string& path, const std::string& test_name,
+    unsigned short first_cpuid, unsigned short second_cpuid, double tsc_ghz, const raw_samples& samples);
+
+/*
+ * A file of raw samples mapped for reading. Throws std::system_error if the file can't be mapped
+ * and std::runtime_error if it isn't a valid sample dump.
+ */
+class sample_dump {
+    void* m_addr = nullptr;
+    std::size_t m_size = 0;
+
+public:
+    explicit sample_dump(const std::string& path);
+    sample_dump(const sample_dump&) = delete;
+    ~sample_dump();
+
+    const sample_dump_header& header() const noexcept {
+        return *static_cast<const sample_dump_header*>(m_addr);
+    }
+
+    // m_count samples, twice as many words for pairs
+    const std::uint64_t* samples() const noexcept {
+        return reinterpret_cast<const std::uint64_t*>(&header() + 1);
+    }
+};
@@ -0,0 +1,19 @@
+// vim: textwidth=100
+#pragma once
+
+#include <cstddef>
+#include <atomic>
+
+// like std::latch, but without going into kernel space
+class spin_latch {
+    std::atomic<std::ptrdiff_t> m_counter;
+public:
+    explicit spin_latch(std::ptrdiff_t expected) : m_counter(expected) {}
+    spin_latch(const spin_latch&) = delete;
+    void arrive_and_wait(std::ptrdiff_t n = 1) noexcept {
+        if (m_counter.fetch_sub(n, std::memory_order_relaxed) == n)
+            return;
+        while (m_counter.load(std::memory_order_relaxed) != 0)
+            ;
+    }
+};
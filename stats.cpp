@@ -0,0 +1,320 @@
+// vim: textwidth=100
+#include "stats.h"
+
+#include <cmath>
+#include <cstdint>
+#include <algorithm>
+#include <atomic>
+#include <iomanip>
+#include <iterator>
+#include <numeric>
+#include <ostream>
+#include <sstream>
+#include <random>
+#include <system_error>
+#include <thread>
+
+namespace {
+
+constexpr std::size_t g_tails_count = std::size(sample_stats::s_tail_quantiles);
+// number of resamples the bootstrap distributions consist of
+constexpr std::size_t g_resamples = 1000;
+// The bootstrap takes memory and time proportional to the number of samples for every resample,
+// beyond this number intervals are given by order statistics and the normal approximation of the
+// mean, which are as good for that many samples.
+constexpr std::size_t g_bootstrap_max_samples = 100000;
+
+// how many extreme samples on every edge are excluded from the mean and the rms
+std::size_t edge_size(std::size_t count) noexcept {
+    return count > 6 ? 3 : 0;
+}
+
+std::size_t quantile_rank(std::size_t count, double q) noexcept {
+    return std::min(count - 1, static_cast<std::size_t>(static_cast<double>(count) * q));
+}
+
+// statistics of a single resample
+struct resample_stats {
+    double m_mean;
+    double m_median;
+    double m_tail[g_tails_count];
+};
+
+/*
+ * A resample of sorted samples is represented by how many times every sample is drawn, so the
+ * statistics are calculated by a single pass over the samples in order without sorting the
+ * resample.
+ */
+resample_stats calc_resample_stats(const std::vector<double>& sorted,
+        std::vector<std::uint32_t>& multiplicity, std::mt19937_64& rng) {
+    const auto count = sorted.size();
+    std::fill(multiplicity.begin(), multiplicity.end(), 0);
+    // a random number is scaled to the range by multiplication instead of division, it's the most
+    // expensive part of the bootstrap and the tiny bias doesn't matter here
+    for (std::size_t i = 0; i < count; ++i)
+        ++multiplicity[static_cast<std::size_t>((static_cast<unsigned __int128>(rng()) * count) >> 64)];
+
+    const auto edge = edge_size(count);
+    // ranks of the median and the tail quantiles in ascending order
+    std::size_t ranks[1 + g_tails_count] = {quantile_rank(count, 0.5)};
+    for (std::size_t i = 0; i < g_tails_count; ++i)
+        ranks[1 + i] = quantile_rank(count, sample_stats::s_tail_quantiles[i]);
+
+    resample_stats res{};
+    double* values[1 + g_tails_count] = {&res.m_median};
+    for (std::size_t i = 0; i < g_tails_count; ++i)
+        values[1 + i] = &res.m_tail[i];
+
+    double sum = 0.0;
+    std::size_t rank = 0, next_rank = 0;
+    for (std::size_t idx = 0; idx < count; ++idx) {
+        const std::size_t times = multiplicity[idx];
+        if (times == 0)
+            continue;
+
+        // the part of the drawn copies which isn't cut off as an edge
+        const auto first = std::max(rank, edge);
+        const auto last = std::min(rank + times, count - edge);
+        if (first < last)
+            sum += sorted[idx] * static_cast<double>(last - first);
+
+        rank += times;
+        while (next_rank < std::size(ranks) && ranks[next_rank] < rank)
+            *values[next_rank++] = sorted[idx];
+    }
+    res.m_mean = sum / static_cast<double>(count - 2 * edge);
+
+    return res;
+}
+
+// the central 95% of the bootstrap distribution of a statistic
+void set_interval(estimate& est, std::vector<double>& distribution) {
+    std::sort(distribution.begin(), distribution.end());
+    est.m_low = distribution[quantile_rank(distribution.size(), 0.025)];
+    est.m_high = distribution[quantile_rank(distribution.size(), 0.975)];
+}
+
+// the distribution free interval of a quantile given by ranks n*q -/+ 1.96*sqrt(n*q*(1-q))
+void set_order_interval(estimate& est, const std::vector<double>& sorted, double q) {
+    const double n = static_cast<double>(sorted.size());
+    const auto spread = 1.96 * std::sqrt(n * q * (1.0 - q));
+    est.m_low = sorted[static_cast<std::size_t>(std::max(0.0, std::floor(n * q - spread)))];
+    est.m_high = sorted[static_cast<std::size_t>(std::min(n - 1.0, std::ceil(n * q + spread)))];
+}
+
+// the lower bound of the histogram bin a value falls in
+double histogram_bin(double value) {
+    constexpr int precision_bits = 10;
+    if (value < double{1 << precision_bits})
+        return std::floor(value);
+    const auto step = std::ldexp(1.0, std::ilogb(value) - precision_bits + 1);
+    return std::floor(value / step) * step;
+}
+
+std::uint64_t histogram_count(const histogram& hist) {
+    return std::accumulate(hist.begin(), hist.end(), std::uint64_t{0},
+        [](auto l, const auto& r){ return l + r.second; });
+}
+
+} // ns anonymous
+
+sample_stats calc_stats(std::vector<double>& samples) {
+    sample_stats res;
+    res.m_count = samples.size();
+    if (samples.empty())
+        return res;
+
+    std::sort(samples.begin(), samples.end());
+
+    const auto count = samples.size();
+    const auto edge = edge_size(count);
+    const auto mean = std::accumulate(samples.begin() + edge, samples.end() - edge, 0.0) / (count - 2 * edge);
+    res.m_rms = std::pow(
+        std::accumulate(samples.begin() + edge, samples.end() - edge, 0.0,
+                [mean](auto l, auto r){ return std::pow(r - mean, 2.0) + l; })
+            / (count - 2 * edge),
+        0.5);
+
+    res.m_mean = {mean, mean, mean};
+    const auto median = samples[count / 2];
+    res.m_median = {median, median, median};
+    for (std::size_t i = 0; i < g_tails_count; ++i) {
+        const auto value = samples[quantile_rank(count, sample_stats::s_tail_quantiles[i])];
+        res.m_tail[i] = {value, value, value};
+    }
+
+    if (count < 2)
+        return res;
+
+    if (count > g_bootstrap_max_samples) {
+        const auto spread = 1.96 * res.m_rms / std::sqrt(static_cast<double>(count - 2 * edge));
+        res.m_mean = {mean, mean - spread, mean + spread};
+        set_order_interval(res.m_median, samples, 0.5);
+        for (std::size_t i = 0; i < g_tails_count; ++i)
+            set_order_interval(res.m_tail[i], samples, sample_stats::s_tail_quantiles[i]);
+        return res;
+    }
+
+    // resamples are distributed between threads dynamically, so the calling thread does all the
+    // work alone if no thread can be started
+    std::vector<resample_stats> resamples(g_resamples);
+    std::atomic<std::size_t> next_resample{0};
+    auto process = [&](){
+        std::vector<std::uint32_t> multiplicity(count);
+        for (auto idx = next_resample++; idx < g_resamples; idx = next_resample++) {
+            // every resample has its own seed to get the same result regardless of the threads
+            std::mt19937_64 rng{idx};
+            resamples[idx] = calc_resample_stats(samples, multiplicity, rng);
+        }
+    };
+
+    std::vector<std::thread> threads;
+    for (auto idx = std::thread::hardware_concurrency(); idx > 1; --idx)
+        try {
+            threads.emplace_back(process);
+        } catch (const std::system_error&) {
+            break;
+        }
+    process();
+    for (auto& thread : threads)
+        thread.join();
+
+    std::vector<double> distribution(g_resamples);
+    auto interval = [&](estimate& est, auto&& statistic){
+        std::transform(resamples.begin(), resamples.end(), distribution.begin(), statistic);
+        set_interval(est, distribution);
+    };
+    interval(res.m_mean, [](const auto& r){ return r.m_mean; });
+    interval(res.m_median, [](const auto& r){ return r.m_median; });
+    for (std::size_t i = 0; i < g_tails_count; ++i)
+        interval(res.m_tail[i], [i](const auto& r){ return r.m_tail[i]; });
+
+    return res;
+}
+
+void print_stats(std::ostream& os, const sample_stats& stats, double cpufreq_ghz) {
+    auto print = [&os, cpufreq_ghz](const auto& label, const estimate& est){
+        os << "  " << std::left << std::setw(13) << label << std::right << ": " << est.m_value
+            << " (" << est.m_value / cpufreq_ghz << "ns), 95% CI [" << est.m_low << ", " << est.m_high << "]";
+    };
+
+    os <<
+        "  freq, GHz    : " << cpufreq_ghz << "\n"
+        "  measures     : " << stats.m_count << "\n";
+    print("cycles mean", stats.m_mean);
+    os << "\n"
+        "  cycles rms   : " << stats.m_rms << " (" << stats.m_rms / cpufreq_ghz << "ns)\n";
+    print("cycles median", stats.m_median);
+    for (std::size_t i = 0; i < g_tails_count; ++i) {
+        std::ostringstream label;
+        label << "cycles p" << sample_stats::s_tail_quantiles[i] * 100;
+        os << "\n";
+        print(label.str(), stats.m_tail[i]);
+    }
+}
+
+std::vector<std::optional<std::pair<double, double>>> quantiles_ci(
+        std::vector<double> samples, const std::vector<double>& quantiles) {
+    std::vector<std::optional<std::pair<double, double>>> res;
+    const double n = static_cast<double>(samples.size());
+    // samples before it aren't greater than any sample after it
+    auto first = samples.begin();
+    for (auto q : quantiles) {
+        const auto spread = 1.96 * std::sqrt(n * q * (1.0 - q));
+        const auto lo = std::floor(n * q - spread);
+        const auto hi = std::ceil(n * q + spread);
+        if (lo < 0.0 || hi >= n) {
+            res.emplace_back();
+            continue;
+        }
+        auto lo_it = samples.begin() + static_cast<std::ptrdiff_t>(lo);
+        auto hi_it = samples.begin() + static_cast<std::ptrdiff_t>(hi);
+        std::nth_element(lo_it < first ? samples.begin() : first, lo_it, samples.end());
+        if (hi_it != lo_it)
+            std::nth_element(lo_it + 1, hi_it, samples.end());
+        res.emplace_back(std::make_pair(*lo_it, *hi_it));
+        first = lo_it + 1;
+    }
+    return res;
+}
+
+histogram make_histogram(const std::vector<double>& samples) {
+    std::vector<double> bins;
+    bins.reserve(samples.size());
+    std::transform(samples.begin(), samples.end(), std::back_inserter(bins), histogram_bin);
+    std::sort(bins.begin(), bins.end());
+
+    histogram res;
+    for (auto bin : bins)
+        if (! res.empty() && res.back().first == bin)
+            ++res.back().second;
+        else
+            res.emplace_back(bin, 1);
+    return res;
+}
+
+double histogram_median(const histogram& hist) {
+    return histogram_quantile(hist, 0.5);
+}
+
+double histogram_quantile(const histogram& hist, double q) {
+    const auto rank = static_cast<std::uint64_t>(q * static_cast<double>(histogram_count(hist)));
+    std::uint64_t seen = 0;
+    for (const auto& [value, count] : hist)
+        if (seen += count; seen > rank)
+            return value;
+    return hist.empty() ? 0.0 : hist.back().first;
+}
+
+void merge_histogram(histogram& to, const histogram& from) {
+    histogram res;
+    res.reserve(to.size() + from.size());
+    std::merge(to.begin(), to.end(), from.begin(), from.end(), std::back_inserter(res),
+        [](const auto& l, const auto& r){ return l.first < r.first; });
+
+    // counts of a bin present in both histograms are added up
+    auto out = res.begin();
+    for (auto it = res.begin(); it != res.end(); ++it)
+        if (out != res.begin() && std::prev(out)->first == it->first)
+            std::prev(out)->second += it->second;
+        else
+            *out++ = *it;
+    res.erase(out, res.end());
+    to = std::move(res);
+}
+
+mann_whitney_result mann_whitney(const histogram& first, const histogram& second) {
+    const double n1 = static_cast<double>(histogram_count(first));
+    const double n2 = static_cast<double>(histogram_count(second));
+    const double n = n1 + n2;
+    mann_whitney_result res;
+    if (n1 == 0.0 || n2 == 0.0)
+        return res;
+
+    // rank sum of the second sample, every bin of tied samples gets their average rank
+    double rank_sum = 0.0, ties = 0.0, ranked = 0.0;
+    for (auto it1 = first.begin(), it2 = second.begin(); it1 != first.end() || it2 != second.end(); ) {
+        double count1 = 0.0, count2 = 0.0;
+        if (it2 == second.end() || (it1 != first.end() && it1->first <= it2->first)) {
+            count1 = static_cast<double>(it1->second);
+            if (it2 != second.end() && it1->first == it2->first)
+                count2 = static_cast<double>((it2++)->second);
+            ++it1;
+        } else
+            count2 = static_cast<double>((it2++)->second);
+
+        const auto tied = count1 + count2;
+        rank_sum += count2 * (ranked + (tied + 1.0) / 2.0);
+        ties += tied * tied * tied - tied;
+        ranked += tied;
+    }
+
+    const auto u = rank_sum - n2 * (n2 + 1.0) / 2.0;
+    const auto variance = n1 * n2 / 12.0 * ((n + 1.0) - ties / (n * (n - 1.0)));
+    if (variance <= 0.0)
+        return res;
+
+    res.m_z = (u - n1 * n2 / 2.0) / std::sqrt(variance);
+    res.m_p_value = 0.5 * std::erfc(res.m_z / std::sqrt(2.0));
+    return res;
+}
@@ -0,0 +1,68 @@
+// vim: textwidth=100
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <iosfwd>
+#include <iterator>
+#include <optional>
+#include <utility>
+#include <vector>
+
+/*
+ * Statistics of latency samples. Confidence intervals are 95% ones.
+ */
+
+// a point estimate with its confidence interval
+struct estimate {
+    double m_value = 0.0;
+    double m_low = 0.0;
+    double m_high = 0.0;
+};
+
+struct sample_stats {
+    // quantiles reported along with the median
+    static constexpr double s_tail_quantiles[] = {0.9, 0.99, 0.999};
+
+    std::size_t m_count = 0;
+    // the mean and the rms exclude a few extreme samples on both edges
+    estimate m_mean;
+    double m_rms = 0.0;
+    estimate m_median;
+    estimate m_tail[std::size(s_tail_quantiles)];
+};
+
+// Sorts the samples and calculates their statistics. Confidence intervals are calculated by the
+// percentile bootstrap, resamples are processed by all the CPU cores, so it shouldn't be called
+// while workers are measuring something. For more than 100000 samples the intervals are given by
+// order statistics and the normal approximation of the mean instead.
+sample_stats calc_stats(std::vector<double>& samples);
+
+// print the statistics in cycles and nanoseconds, without a trailing new line
+void print_stats(std::ostream& os, const sample_stats& stats, double cpufreq_ghz);
+
+// Distribution free confidence intervals of quantiles given by order statistics of samples, i.e.
+// ranks n*q -/+ 1.96*sqrt(n*q*(1-q)), empty if there are too few samples for a quantile. The
+// quantiles are expected in ascending order.
+std::vector<std::optional<std::pair<double, double>>> quantiles_ci(
+    std::vector<double> samples, const std::vector<double>& quantiles);
+
+// Counts of samples by bins sorted by value. A bin is 1 cycle wide up to 1024 cycles and then it
+// keeps 10 significant bits of a value, so the relative error is below 0.2%.
+using histogram = std::vector<std::pair<double, std::uint64_t>>;
+
+histogram make_histogram(const std::vector<double>& samples);
+double histogram_median(const histogram& hist);
+// the bin the quantile falls into, zero if the histogram is empty
+double histogram_quantile(const histogram& hist, double q);
+// add counts of the second histogram to the first one
+void merge_histogram(histogram& to, const histogram& from);
+
+struct mann_whitney_result {
+    double m_z = 0.0;
+    double m_p_value = 1.0;
+};
+
+// One-sided Mann-Whitney U test whether samples of the second histogram tend to be greater than
+// ones of the first histogram, samples of the same bin are ties. Uses the normal approximation.
+mann_whitney_result mann_whitney(const histogram& first, const histogram& second);
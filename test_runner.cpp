@@ -0,0 +1,432 @@
+// vim: textwidth=100
+#include "test_runner.h"
+#include "spin_latch.h"
+#include "topology.h"
+#include "memory.h"
+#include "stats.h"
+#include "tsc.h"
+
+#include <cerrno>
+#include <cstring>
+#include <iomanip>
+#include <algorithm>
+#include <exception>
+#include <new>
+#include <optional>
+#include <random>
+#include <stdexcept>
+#include <system_error>
+#include <thread>
+#include <utility>
+
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/prctl.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+namespace {
+
+// samples of all the runs of a timeline kept for the overall statistics
+constexpr std::size_t g_timeline_reservoir_size = 100000;
+
+} // ns anonymous
+
+int test_runner::run(test_case_iface& test_case) {
+    auto prepare = [&test_case](std::size_t idx){
+        if (idx == 0)
+            test_case.one_prepare();
+        else
+            test_case.another_prepare();
+    };
+    auto work = [&test_case](std::size_t idx){
+        if (idx == 0)
+            test_case.one_work();
+        else
+            test_case.another_work();
+    };
+
+    if (m_options.m_timeline_bucket.count() > 0)
+        return run_timeline(test_case, prepare, work);
+
+    if (m_options.m_adaptive_ci <= 0.0)
+        return run_workers(2, prepare, work,
+            [&test_case](std::ostream& os){ test_case.report(os); },
+            [](){ return true; });
+
+    const std::vector<double> quantiles{0.5, 0.99};
+    const auto deadline = std::chrono::steady_clock::now() + m_options.m_time_budget;
+    std::size_t runs = 0;
+    bool converged = false;
+    std::vector<std::optional<std::pair<double, double>>> intervals;
+
+    auto done = [&](){
+        ++runs;
+        const auto* samples = test_case.collect_samples();
+        if (! samples) {
+            *m_options.m_err << "warning: the test case doesn't provide its samples, adaptive sampling is disabled" << std::endl;
+            return true;
+        }
+
+        intervals = quantiles_ci(*samples, quantiles);
+        converged = std::all_of(intervals.begin(), intervals.end(), [this](const auto& ci){
+            return ci && ci->second - ci->first <= m_options.m_adaptive_ci * ci->second;
+        });
+        return converged || std::chrono::steady_clock::now() >= deadline;
+    };
+
+    auto report = [&](std::ostream& os){
+        if (! intervals.empty()) {
+            os << "  runs         : " << runs << (converged ? " (converged)" : " (time budget is over)") << "\n";
+            auto q = quantiles.begin();
+            for (const auto& ci : intervals) {
+                os << "  p" << *q++ * 100 << " 95% CI   : ";
+                if (ci)
+                    os << "[" << ci->first << ", " << ci->second << "] cycles\n";
+                else
+                    os << "too few samples\n";
+            }
+        }
+        test_case.report(os);
+    };
+
+    return run_workers(2, prepare, work, report, done);
+}
+
+template <typename Prepare, typename Work>
+int test_runner::run_timeline(test_case_iface& test_case, Prepare& prepare, Work& work) {
+    struct bucket {
+        histogram m_histogram;
+        std::uint64_t m_count = 0;
+        double m_ratio_sum = 0.0;
+        std::size_t m_runs = 0;
+    };
+
+    const auto start = std::chrono::steady_clock::now();
+    const auto deadline = start + m_options.m_time_budget;
+    std::vector<bucket> buckets;
+    // a uniform random subset of samples of all the runs the test case reports statistics of,
+    // so memory and the cost of the statistics don't grow with the length of the soak
+    std::vector<double> reservoir;
+    std::uint64_t seen = 0;
+    std::mt19937_64 random;
+
+    auto done = [&](){
+        const auto* samples = test_case.collect_samples();
+        if (! samples) {
+            *m_options.m_err << "warning: the test case doesn't provide its samples, timeline is disabled" << std::endl;
+            return true;
+        }
+
+        const auto now = std::chrono::steady_clock::now();
+        const auto idx = static_cast<std::size_t>((now - start) / m_options.m_timeline_bucket);
+        if (buckets.size() <= idx)
+            buckets.resize(idx + 1);
+        auto& current = buckets[idx];
+        // samples of the previous runs are the reservoir given back to the test case
+        const std::vector<double> fresh{samples->begin() + static_cast<std::ptrdiff_t>(reservoir.size()), samples->end()};
+        merge_histogram(current.m_histogram, make_histogram(fresh));
+        current.m_count += fresh.size();
+        current.m_ratio_sum += measure_core_to_tsc_ratio(m_cpuids[0]);
+        ++current.m_runs;
+
+        for (auto sample : fresh) {
+            if (reservoir.size() < g_timeline_reservoir_size)
+                reservoir.push_back(sample);
+            else if (auto pos = random() % (seen + 1); pos < g_timeline_reservoir_size)
+                reservoir[pos] = sample;
+            ++seen;
+        }
+        test_case.replace_samples(reservoir);
+
+        return now >= deadline;
+    };
+
+    auto report = [&](std::ostream& os){
+        if (seen > reservoir.size())
+            os << "  samples      : " << seen << ", statistics are of a random subset of " << reservoir.size() << "\n";
+        test_case.report(os);
+        os << "\n  timeline, buckets of " << m_options.m_timeline_bucket.count() << "s:\n"
+            "    " << std::setw(8) << "start, s" << std::setw(10) << "samples" << std::setw(12) << "p50"
+            << std::setw(12) << "p90" << std::setw(12) << "p99" << std::setw(12) << "max"
+            << std::setw(10) << "core/TSC";
+        for (std::size_t idx = 0; idx < buckets.size(); ++idx) {
+            const auto& hist = buckets[idx].m_histogram;
+            os << "\n    " << std::setw(8) << idx * m_options.m_timeline_bucket.count()
+                << std::setw(10) << buckets[idx].m_count;
+            if (hist.empty()) {
+                os << "  no run finished";
+                continue;
+            }
+            for (auto q : {0.5, 0.9, 0.99})
+                os << std::setw(12) << histogram_quantile(hist, q);
+            os << std::setw(12) << hist.back().first << std::setw(10) << std::fixed << std::setprecision(3)
+                << buckets[idx].m_ratio_sum / static_cast<double>(buckets[idx].m_runs) << std::defaultfloat
+                << std::setprecision(6);
+        }
+    };
+
+    return run_workers(2, prepare, work, report, done);
+}
+
+int test_runner::run_processes(test_case_iface& test_case) {
+    struct control_block {
+        spin_latch m_start_barrier{2};
+        std::atomic<bool> m_failed{false};
+        long m_page_faults[2] = {};
+    };
+
+    cpu_set_t parent_cpu_set;
+    if (auto res = pthread_getaffinity_np(pthread_self(), sizeof(cpu_set_t), &parent_cpu_set); res != 0) {
+        *m_options.m_err << "unable to get thread affinity: " << std::strerror(res) << std::endl;
+        return 1;
+    }
+
+    try {
+        set_thread_affinity(m_cpuids[0]);
+        test_case.one_prepare();
+        set_thread_affinity(m_cpuids[1]);
+        test_case.another_prepare();
+    } catch (const std::exception& e) {
+        pthread_setaffinity_np(pthread_self(), sizeof(cpu_set_t), &parent_cpu_set);
+        *m_options.m_err << "unexpected exception at preparation: " << e.what() << std::endl;
+        return 1;
+    }
+    pthread_setaffinity_np(pthread_self(), sizeof(cpu_set_t), &parent_cpu_set);
+
+    mapping_options control_opts;
+    control_opts.m_shared = true;
+    auto control = new (map_memory(sizeof(control_block), control_opts)) control_block;
+
+    // don't let children flush what the parent has buffered
+    m_options.m_out->flush();
+    m_options.m_err->flush();
+
+    pid_t pids[2] = {-1, -1};
+    for (std::size_t idx = 0; idx < 2; ++idx) {
+        if (pids[idx] = fork(); pids[idx] == 0) {
+            int code = 0;
+            try {
+                set_thread_affinity(m_cpuids[idx]);
+                if (auto warning = set_thread_scheduling(); ! warning.empty())
+                    *m_options.m_err << "warning: worker " << idx + 1 << ": " << warning << std::endl;
+                // locks aren't inherited by a child, and locking breaks copy-on-write of its pages
+                if (auto warning = lock_all_memory(); ! warning.empty())
+                    *m_options.m_err << "warning: worker " << idx + 1 << ": " << warning << std::endl;
+            } catch (const std::exception& e) {
+                *m_options.m_err << "unexpected exception at worker " << idx + 1 << ": " << e.what() << std::endl;
+                control->m_failed.store(true, std::memory_order_relaxed);
+                code = 1;
+            }
+
+            control->m_start_barrier.arrive_and_wait();
+            if (! control->m_failed.load(std::memory_order_relaxed)) {
+                const auto faults_before = thread_page_faults();
+                if (idx == 0)
+                    test_case.one_work();
+                else
+                    test_case.another_work();
+                control->m_page_faults[idx] = thread_page_faults() - faults_before;
+            }
+            m_options.m_err->flush();
+            _exit(code);
+        } else if (pids[idx] < 0) {
+            *m_options.m_err << "unable to fork worker " << idx + 1 << ": " << std::strerror(errno) << std::endl;
+            // let the already forked worker pass the barrier and exit
+            control->m_failed.store(true, std::memory_order_relaxed);
+            if (idx == 1)
+                control->m_start_barrier.arrive_and_wait();
+            break;
+        }
+    }
+
+    int res = control->m_failed.load(std::memory_order_relaxed) ? 1 : 0;
+    for (auto pid : pids)
+        if (int status; pid > 0 && (waitpid(pid, &status, 0) != pid || ! WIFEXITED(status) || WEXITSTATUS(status) != 0))
+            res = 1;
+
+    if (res == 0 && ! m_options.m_quiet)
+        print_result(control->m_page_faults, 2, [&test_case](std::ostream& os){ test_case.report(os); });
+
+    unmap_memory(control, sizeof(control_block));
+    return res;
+}
+
+int test_runner::run(multi_test_case_iface& test_case) {
+    return run_workers(test_case.workers_count(),
+        [&test_case](std::size_t idx){ test_case.prepare(idx); },
+        [&test_case](std::size_t idx){ test_case.work(idx); },
+        [&test_case](std::ostream& os){ test_case.report(os); },
+        [](){ return true; });
+}
+
+double test_runner::measure_core_to_tsc_ratio(unsigned short cpuid) {
+    cpu_set_t cpu_set;
+    if (auto res = pthread_getaffinity_np(pthread_self(), sizeof(cpu_set_t), &cpu_set); res != 0)
+        throw std::system_error{std::make_error_code((std::errc)res), "unable to get thread affinity"};
+    set_thread_affinity(cpuid);
+    const auto res = core_to_tsc_ratio();
+    pthread_setaffinity_np(pthread_self(), sizeof(cpu_set_t), &cpu_set);
+    return res;
+}
+
+template <typename Prepare, typename Work, typename Report, typename Done>
+int test_runner::run_workers(std::size_t workers_count, Prepare&& prepare, Work&& work, Report&& report, Done&& done) {
+    // page faults taken by every worker during the main part
+    std::vector<long> page_faults(workers_count);
+    std::vector<std::vector<perf_counters::value>> counters(workers_count);
+
+    for (bool first_run = true; ; first_run = false) {
+        if (auto res = run_workers_once(workers_count, prepare, work, page_faults, counters, first_run); res != 0)
+            return res;
+        if (done())
+            break;
+    }
+
+    if (m_options.m_quiet)
+        return 0;
+
+    print_result(page_faults.data(), workers_count, report);
+    if (m_options.m_perf_counters)
+        print_counters(counters);
+
+    return 0;
+}
+
+template <typename Prepare, typename Work>
+int test_runner::run_workers_once(std::size_t workers_count, Prepare& prepare, Work& work, std::vector<long>& page_faults,
+        std::vector<std::vector<perf_counters::value>>& counters, bool first_run) {
+    int res = 0;
+    std::vector<std::exception_ptr> errors(workers_count);
+    std::vector<std::string> warnings(workers_count);
+    std::atomic<bool> failed{false};
+    spin_latch start_barrier{static_cast<std::ptrdiff_t>(workers_count)};
+    std::vector<std::thread> workers;
+
+    workers.reserve(workers_count);
+    for (std::size_t idx = 0; idx < workers_count; ++idx)
+        workers.emplace_back([&, idx](){
+            std::optional<perf_counters> perf;
+            try {
+                set_thread_affinity(m_cpuids[idx]);
+                warnings[idx] = set_thread_scheduling();
+                prepare(idx);
+                if (auto warning = lock_all_memory(); ! warning.empty())
+                    warnings[idx] += (warnings[idx].empty() ? "" : "; ") + warning;
+                if (m_options.m_perf_counters)
+                    perf.emplace(m_options.m_raw_perf_events);
+            } catch (...) {
+                errors[idx] = std::current_exception();
+                failed.store(true, std::memory_order_relaxed);
+            }
+
+            start_barrier.arrive_and_wait();
+            if (failed.load(std::memory_order_relaxed))
+                return;
+
+            const auto faults_before = thread_page_faults();
+            if (perf)
+                perf->start();
+            work(idx);
+            if (perf)
+                perf->stop();
+            page_faults[idx] += thread_page_faults() - faults_before;
+            if (perf) {
+                auto values = perf->read();
+                if (counters[idx].size() != values.size())
+                    counters[idx] = std::move(values);
+                else
+                    for (std::size_t i = 0; i < values.size(); ++i)
+                        counters[idx][i].m_value += values[i].m_value;
+            }
+        });
+
+    for (auto& worker : workers)
+        worker.join();
+
+    // the same warnings are issued by every run
+    for (std::size_t idx = 0; idx < workers_count && first_run; ++idx)
+        if (! warnings[idx].empty())
+            *m_options.m_err << "warning: worker " << idx + 1 << ": " << warnings[idx] << std::endl;
+
+    unsigned short worker_idx = 1;
+    for (auto& exc_ptr : errors) {
+        if (exc_ptr)
+            try {
+                res = 1;
+                std::rethrow_exception(exc_ptr);
+            } catch (const std::exception& e) {
+                *m_options.m_err << "unexpected exception at worker " << worker_idx
+                    << ": " << e.what() << std::endl;
+            } catch (...) {
+                *m_options.m_err << "unexpected error at worker " << worker_idx << std::endl;
+            }
+        ++worker_idx;
+    }
+
+    return res;
+}
+
+template <typename Report>
+void test_runner::print_result(const long* page_faults, std::size_t workers_count, Report&& report) {
+    *m_options.m_out << "Workers placement:" << std::endl;
+    for (std::size_t idx = 0; idx < workers_count; ++idx)
+        *m_options.m_out << "  worker " << idx + 1 << ": cpu " << m_cpuids[idx]
+            << " (package " << cpu_package_id(m_cpuids[idx])
+            << ", core " << cpu_core_id(m_cpuids[idx])
+            << ", node " << cpu_numa_node(m_cpuids[idx]) << "), page faults during work: "
+            << page_faults[idx] << std::endl;
+    *m_options.m_out << "Test case result:" << std::endl;
+    report(*m_options.m_out);
+    *m_options.m_out << std::endl;
+}
+
+void test_runner::print_counters(const std::vector<std::vector<perf_counters::value>>& counters) const {
+    *m_options.m_out << "Performance counters during work:" << std::endl;
+    for (std::size_t idx = 0; idx < counters.size(); ++idx) {
+        *m_options.m_out << "  worker " << idx + 1 << ":";
+        if (counters[idx].empty())
+            *m_options.m_out << " no events available";
+        for (std::size_t i = 0; i < counters[idx].size(); ++i)
+            *m_options.m_out << (i ? ", " : " ") << counters[idx][i].m_name << " " << counters[idx][i].m_value;
+        *m_options.m_out << std::endl;
+    }
+}
+
+std::string test_runner::lock_all_memory() const {
+    if (m_options.m_lock_all && mlockall(MCL_CURRENT) != 0)
+        return std::string{"unable to lock process memory: "} + std::strerror(errno);
+    return {};
+}
+
+std::string test_runner::set_thread_scheduling() const {
+    std::string res;
+
+    if (m_options.m_sched_policy != SCHED_OTHER) {
+        sched_param param{};
+        param.sched_priority = m_options.m_sched_priority;
+        if (auto err = pthread_setschedparam(pthread_self(), m_options.m_sched_policy, &param); err != 0)
+            res = std::string{"unable to set real-time scheduling: "} + std::strerror(err);
+    }
+
+    if (m_options.m_min_timer_slack && prctl(PR_SET_TIMERSLACK, 1ul, 0ul, 0ul, 0ul) != 0)
+        res += (res.empty() ? "" : "; ") + std::string{"unable to set timer slack: "} + std::strerror(errno);
+
+    return res;
+}
+
+long test_runner::thread_page_faults() noexcept {
+    rusage usage;
+    if (getrusage(RUSAGE_THREAD, &usage) != 0)
+        return 0;
+    return usage.ru_minflt + usage.ru_majflt;
+}
+
+void test_runner::set_thread_affinity(unsigned short cpuid) {
+    cpu_set_t cpu_set;
+    CPU_ZERO(&cpu_set);
+    CPU_SET(cpuid, &cpu_set);
+    if (auto res = pthread_setaffinity_np(pthread_self(), sizeof(cpu_set_t), &cpu_set); res != 0)
+        throw std::system_error{std::make_error_code((std::errc)res), "unable to set thread affinity"};
+}
@@ -0,0 +1,117 @@
+// vim: textwidth=100
+#pragma once
+
+#include "tests.h"
+#include "perf_counters.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <chrono>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include <sched.h>
+
+struct runner_options {
+    // count performance events during the main part of every worker
+    bool m_perf_counters = false;
+    // codes of model specific events counted in addition to the generic ones
+    std::vector<std::uint64_t> m_raw_perf_events;
+    // scheduling policy and priority of workers
+    int m_sched_policy = SCHED_OTHER;
+    int m_sched_priority = 0;
+    // lock all the process memory in RAM before starting workers
+    bool m_lock_all = false;
+    // make workers' timers as precise as possible
+    bool m_min_timer_slack = false;
+    // repeat runs of a two-sided test until 95% confidence intervals of the median and the 99th
+    // percentile are narrower than this share of their values, zero disables it
+    double m_adaptive_ci = 0.0;
+    // stop repeating runs when the time is over even if the intervals are still wider
+    std::chrono::seconds m_time_budget{60};
+    // don't print results of a test case, e.g. when results of many runs are summarized
+    bool m_quiet = false;
+    // repeat runs of a two-sided test for the time budget and report statistics of samples
+    // collected within every bucket of this time, zero disables it
+    std::chrono::seconds m_timeline_bucket{0};
+    // where results are printed to and where warnings and errors are reported to
+    std::ostream* m_out = &std::cout;
+    std::ostream* m_err = &std::cerr;
+};
+
+/*
+ * Runs workers of a test case bound to the given CPU cores and prints the report of the test case
+ * with placement of the workers. Problems are reported to the error stream and the run returns
+ * non-zero then.
+ */
+class test_runner {
+    const std::vector<unsigned short> m_cpuids;
+    const runner_options m_options;
+
+public:
+    explicit test_runner(std::vector<unsigned short> cpuids, runner_options opts = {})
+        : m_cpuids(std::move(cpuids)), m_options(std::move(opts)) {}
+
+    /*
+     * Run two threads, bind them to the first two specified CPU cores and execute the test case on
+     * them. If adaptive sampling is requested and the test case provides its samples, the test is
+     * run again and again until the median and the 99th percentile are estimated precisely enough
+     * or the time budget is over.
+     */
+    int run(test_case_iface& test_case);
+
+    /*
+     * Run two processes instead of threads. Both preparation steps are run by the parent process
+     * bound to corresponding CPU cores in turn, then the workers are forked, so everything the
+     * workers exchange and write during the main part must be placed in memory mapped as shared
+     * (see mapping_options::m_shared). It allows to compare latency between processes with the
+     * one between threads of the same process.
+     */
+    int run_processes(test_case_iface& test_case);
+
+    // Run as many threads as the test case needs binding them to specified CPU cores in order
+    int run(multi_test_case_iface& test_case);
+
+    // Measure the core frequency relative to the TSC rate on the CPU core, the calling thread is
+    // moved there for the measurement and then it's moved back
+    static double measure_core_to_tsc_ratio(unsigned short cpuid);
+
+private:
+    /*
+     * Run a two-sided test case again and again for the time budget. Samples of every run are
+     * put into the bucket of wall-clock time the run is finished in, a run is expected to be much
+     * shorter than a bucket. After every run the core frequency relative to the TSC rate is
+     * measured on the CPU core of the first worker, so latency drift can be matched with thermal
+     * throttling or frequency changes during a long soak.
+     */
+    template <typename Prepare, typename Work>
+    int run_timeline(test_case_iface& test_case, Prepare& prepare, Work& work);
+
+    // run workers again and again until done() says it's enough, then report the results of all
+    // the runs
+    template <typename Prepare, typename Work, typename Report, typename Done>
+    int run_workers(std::size_t workers_count, Prepare&& prepare, Work&& work, Report&& report, Done&& done);
+
+    template <typename Prepare, typename Work>
+    int run_workers_once(std::size_t workers_count, Prepare& prepare, Work& work, std::vector<long>& page_faults,
+            std::vector<std::vector<perf_counters::value>>& counters, bool first_run);
+
+    template <typename Report>
+    void print_result(const long* page_faults, std::size_t workers_count, Report&& report);
+
+    void print_counters(const std::vector<std::vector<perf_counters::value>>& counters) const;
+
+    // everything here is best effort: the test is still worth running on a host where the process
+    // lacks privileges, so problems are only reported
+
+    // MCL_FUTURE isn't used as it makes creating threads fail if the limit of locked memory is
+    // reached, so a worker locks everything mapped after its preparation step
+    std::string lock_all_memory() const;
+
+    std::string set_thread_scheduling() const;
+
+    static long thread_page_faults() noexcept;
+
+    static void set_thread_affinity(unsigned short cpuid);
+};
@@ -1,132 +1,196 @@
 // vim: textwidth=100
 #include "tests.h"
+#include "topology.h"
+#include "stats.h"
+#include "tsc.h"
 
 #include <cmath>
 #include <ostream>
 #include <iomanip>
+#include <sstream>
 #include <algorithm>
 #include <numeric>
 #include <chrono>
+#include <limits>
 #include <string_view>
+#include <type_traits>
+#include <stdexcept>
 
-constexpr std::size_t g_cache_line_size = 64;
+#include <sched.h>
+#include <time.h>
 
 namespace {
 
-/*
- * Assume that any operation on caches operates with a data block of one cache line, so it doesn't
- * matter, whether we invalidate one byte or the whole cache line. Surround the data with buffers
- * big enough to eliminate false cache sharing.
- */
-char g_pad1[g_cache_line_size];
-std::atomic<std::uint32_t> g_test_data;
-char g_pad2[g_cache_line_size];
-
 inline void code_barrier() {
     asm volatile ("");
 }
 
-inline std::uint64_t rdtsc() {
-    std::uint64_t res;
-    asm volatile ("rdtsc\n"
-                  "shl $32, %%rdx\n"
-                  "or %%rdx, %0\n"
-                  : "=a" (res)
-                  :
-                  : "cc", "rdx");
-    return res;
-}
-
-inline std::uint64_t produce_and_get_cycles(std::uint32_t val) {
+inline std::uint64_t produce_and_get_cycles(std::atomic<std::uint32_t>& data, std::uint32_t val) {
     std::uint64_t res;
     asm volatile ("rdtsc\n"
                   "mov %2, %1\n"
                   "shl $32, %%rdx\n"
                   "or %%rdx, %0\n"
-                  : "=a" (res), "=m" (g_test_data)
+                  : "=a" (res), "=m" (data)
                   : "b" (val)
                   : "cc", "rdx");
     return res;
 }
 
-inline std::uint64_t consume_and_get_cycles(std::uint32_t& val) {
+inline std::uint64_t consume_and_get_cycles(const std::atomic<std::uint32_t>& data, std::uint32_t& val) {
     std::uint64_t res;
     asm volatile ("mov %2, %1\n"
                   "rdtsc\n"
                   "shl $32, %%rdx\n"
                   "or %%rdx, %0\n"
                   : "=a" (res), "=r" (val)
-                  : "m" (g_test_data)
+                  : "m" (data)
                   : "cc", "rdx");
     return res;
 }
 
-double get_cpu_freq_ghz() {
-    using fp_seconds_t = 
-        std::chrono::duration<double, std::chrono::seconds::period>;
+double median(std::vector<double>& samples) {
+    if (samples.empty())
+        return 0.0;
+    auto mid = samples.begin() + samples.size() / 2;
+    std::nth_element(samples.begin(), mid, samples.end());
+    return *mid;
+}
+
+void calc_and_print_stat(std::ostream& os, std::vector<double>& samples) {
+    if (samples.empty()) {
+        os << "  measures     : 0";
+        return;
+    }
+
+    const auto stats = calc_stats(samples);
+    print_stats(os, stats, get_cpu_freq_ghz());
+}
 
-    auto get_freq_hz = [](){
-        auto time_pt = std::chrono::high_resolution_clock::now();
-        std::uint64_t end_ts, start_ts = rdtsc();
-        do {
-            end_ts = rdtsc();
-        } while (end_ts - start_ts < 1'000'000);
-        return (end_ts - start_ts) /
-            fp_seconds_t(std::chrono::high_resolution_clock::now() - time_pt).count();
-    };
 
-    double freq_prev, freq = get_freq_hz();
-    do {
-        freq_prev = freq;
-        freq = get_freq_hz();
-    } while (std::abs(freq - freq_prev) > 1000.0);
+// how the data is stored and loaded in the memory ordering tests
+enum class store_kind {
+    relaxed,
+    release,
+    seq_cst,
+    // relaxed store followed by a fence
+    mfence,
+    sfence,
+    locked,
+    // store made by the xchg instruction
+    xchg
+};
 
-    return freq / 1'000'000'000.0;
+template <store_kind Kind>
+inline void store_data(std::atomic<std::uint32_t>& data, std::uint32_t val) {
+    if constexpr (Kind == store_kind::xchg)
+        asm volatile ("xchg %0, %1" : "+r" (val), "+m" (data) : : "memory");
+    else if constexpr (Kind == store_kind::release)
+        data.store(val, std::memory_order_release);
+    else if constexpr (Kind == store_kind::seq_cst)
+        data.store(val, std::memory_order_seq_cst);
+    else {
+        data.store(val, std::memory_order_relaxed);
+        if constexpr (Kind == store_kind::mfence)
+            asm volatile ("mfence" ::: "memory");
+        else if constexpr (Kind == store_kind::sfence)
+            asm volatile ("sfence" ::: "memory");
+        else if constexpr (Kind == store_kind::locked)
+            asm volatile ("lock addl $0, (%%rsp)" ::: "memory", "cc");
+    }
 }
 
-void calc_and_print_stat(std::ostream& os, std::vector<double>& samples) {
-    sort(samples.begin(), samples.end());
+template <store_kind Kind>
+inline std::uint32_t load_data(const std::atomic<std::uint32_t>& data) {
+    if constexpr (Kind == store_kind::release)
+        return data.load(std::memory_order_acquire);
+    else if constexpr (Kind == store_kind::seq_cst)
+        return data.load(std::memory_order_seq_cst);
+    else
+        return data.load(std::memory_order_relaxed);
+}
 
-    // cut off edges from the samples sequence
-    const std::size_t edge = samples.size() > 6 ? 3 : 0;
-    auto mean = std::accumulate(samples.begin() + edge, samples.end() - edge, 0.0) / (samples.size() - 2 * edge);
-    auto rms = std::pow(
-        std::accumulate(samples.begin() + edge, samples.end() - edge, 0.0,
-                [mean](auto l, auto r){ return std::pow(r - mean, 2.0) + l; })
-            / (samples.size() - 2 * edge),
-        0.5);
+template <store_kind Kind>
+inline void exchange_data(std::atomic<std::uint32_t>& data, std::uint32_t from, std::uint32_t to) {
+    constexpr auto order =
+        Kind == store_kind::release ? std::memory_order_acq_rel :
+        Kind == store_kind::seq_cst ? std::memory_order_seq_cst : std::memory_order_relaxed;
+    constexpr auto failure_order =
+        Kind == store_kind::release ? std::memory_order_acquire :
+        Kind == store_kind::seq_cst ? std::memory_order_seq_cst : std::memory_order_relaxed;
 
-    const auto cpufreq_ghz = get_cpu_freq_ghz();
+    std::uint32_t v = from;
+    while (! data.compare_exchange_strong(v, to, order, failure_order))
+        v = from;
 
-    os <<
-        "  freq, GHz    : " << cpufreq_ghz << "\n"
-        "  measures     : " << samples.size() << "\n"
-        "  cycles mean  : " << mean << " (" << mean / cpufreq_ghz << "ns)\n"
-        "  cycles rms   : " << rms << " (" << rms / cpufreq_ghz << "ns)\n"
-        "  cycles median: " << samples[samples.size() / 2] << " (" << samples[samples.size() / 2] / cpufreq_ghz << "ns)";
+    if constexpr (Kind == store_kind::mfence)
+        asm volatile ("mfence" ::: "memory");
+    else if constexpr (Kind == store_kind::sfence)
+        asm volatile ("sfence" ::: "memory");
+    else if constexpr (Kind == store_kind::locked)
+        asm volatile ("lock addl $0, (%%rsp)" ::: "memory", "cc");
 }
 
 } // ns anonymous
 
+void one_side_test::set_config(const config& cfg) {
+    m_config = cfg;
+    m_arena = memory_arena{2, m_config.m_memory};
+    m_data = m_arena.create<std::atomic<std::uint32_t>>(0);
+    m_continue = m_arena.create<std::atomic<std::int8_t>>(0);
+    // a test case may be configured again to be reused, samples are counted since then
+    m_samples.clear();
+    m_collected = false;
+    m_gaps_detected = 0;
+    m_gaps_lost = 0;
+    m_longest_gap = 0;
+    m_interrupted = 0;
+}
+
 void one_side_test::one_work() noexcept {
+    if (m_config.m_jitter_threshold)
+        one_work_impl<true>();
+    else
+        one_work_impl<false>();
+}
+
+void one_side_test::another_work() noexcept {
+    if (m_config.m_jitter_threshold)
+        another_work_impl<true>();
+    else
+        another_work_impl<false>();
+}
+
+template <bool DetectJitter>
+void one_side_test::one_work_impl() noexcept {
     std::int8_t cont;
     std::uint32_t data_sample = 1;
     auto start_cycle = &m_start_cycles[0];
 
+    if constexpr (DetectJitter)
+        m_one_jitter.start(rdtsc());
+
     while (true) {
         do {
-            if (cont = m_continue.load(std::memory_order_relaxed); cont < 0)
+            if (cont = m_continue->load(std::memory_order_relaxed); cont < 0)
                 return;
+            if constexpr (DetectJitter)
+                m_one_jitter.tick(rdtsc());
         } while (cont == 0);
 
-        m_continue.store(0, std::memory_order_relaxed);
+        m_continue->store(0, std::memory_order_relaxed);
 
-        // give a chance for another side to prepare for waiting the data change
-        for (int i = 0; i < s_warmup_cycles; ++i)
+        // give a chance for another side to prepare for waiting the data change, the last tick
+        // is taken before the start so the detector's cost stays out of the sample, a gap after
+        // it covers the sample anyway
+        for (int i = 0; i < s_warmup_cycles; ++i) {
             code_barrier();
+            if constexpr (DetectJitter)
+                m_one_jitter.tick(rdtsc());
+        }
 
         *start_cycle = rdtsc();
-        g_test_data.store(data_sample, std::memory_order_relaxed);
+        m_data->store(data_sample, std::memory_order_relaxed);
 
         code_barrier();
 
@@ -135,33 +199,81 @@ void one_side_test::one_work() noexcept {
     }
 }
 
-void one_side_test::another_work() noexcept {
+template <bool DetectJitter>
+void one_side_test::another_work_impl() noexcept {
     auto end_cycle = &m_end_cycles[0];
     std::uint32_t data_sample = 1;
 
+    if constexpr (DetectJitter)
+        m_another_jitter.start(rdtsc());
+
     for (std::uint32_t attempt = 0; attempt < m_config.m_attempts_count; ++attempt) {
-        m_continue.store(1, std::memory_order_relaxed);
+        m_continue->store(1, std::memory_order_relaxed);
 
-        while (g_test_data.load(std::memory_order_relaxed) != data_sample)
-            ;
+        while (m_data->load(std::memory_order_relaxed) != data_sample)
+            if constexpr (DetectJitter)
+                m_another_jitter.tick(rdtsc());
 
-        *end_cycle++ = rdtsc();
+        *end_cycle = rdtsc();
+        if constexpr (DetectJitter)
+            m_another_jitter.tick(*end_cycle);
+        ++end_cycle;
 
         ++data_sample;
     }
 
-    m_continue.store(-1);
+    m_continue->store(-1);
+}
+
+const std::vector<double>* one_side_test::collect_samples() {
+    if (m_collected)
+        return &m_samples;
+    m_collected = true;
+
+    // gaps of both workers ordered by start and the latest end among a gap and all before it
+    std::vector<std::pair<std::uint64_t, std::uint64_t>> gaps;
+    std::vector<std::uint64_t> gaps_end_max;
+    for (const auto* jitter : {&m_one_jitter, &m_another_jitter})
+        gaps.insert(gaps.end(), jitter->m_gaps.begin(), jitter->m_gaps.begin() + jitter->count());
+    std::sort(gaps.begin(), gaps.end());
+    for (const auto& gap : gaps)
+        gaps_end_max.push_back(std::max(gap.second, gaps_end_max.empty() ? 0 : gaps_end_max.back()));
+
+    m_samples.reserve(m_samples.size() + m_start_cycles.size());
+    for (std::size_t i = 0; i < m_start_cycles.size(); ++i) {
+        if (! m_end_cycles[i])
+            continue;
+
+        // is there a gap started before the sample end and finished after the sample start
+        auto it = std::lower_bound(gaps.begin(), gaps.end(), std::make_pair(m_end_cycles[i], std::uint64_t{0}));
+        if (it != gaps.begin() && gaps_end_max[it - gaps.begin() - 1] > m_start_cycles[i]) {
+            ++m_interrupted;
+            continue;
+        }
+
+        m_samples.push_back(static_cast<double>(m_end_cycles[i]) - static_cast<double>(m_start_cycles[i]));
+    }
+
+    m_gaps_detected += gaps.size();
+    m_gaps_lost += m_one_jitter.lost() + m_another_jitter.lost();
+    for (const auto& gap : gaps)
+        m_longest_gap = std::max(m_longest_gap, gap.second - gap.first);
+
+    return &m_samples;
 }
 
 void one_side_test::report(std::ostream& os) {
-    std::vector<double> samples;
+    collect_samples();
 
-    samples.reserve(m_start_cycles.size());
-    for (std::size_t i = 0; i < m_start_cycles.size(); ++i)
-        if (m_end_cycles[i])
-            samples.push_back(static_cast<double>(m_end_cycles[i]) - static_cast<double>(m_start_cycles[i]));
+    if (m_config.m_jitter_threshold) {
+        os <<
+            "  gaps detected: " << m_gaps_detected << " (longest " << m_longest_gap << " cycles)\n"
+            "  interrupted  : " << m_interrupted << " samples excluded\n";
+        if (m_gaps_lost)
+            os << "  gaps lost    : " << m_gaps_lost << " (too many gaps to record, some samples may be polluted)\n";
+    }
 
-    calc_and_print_stat(os, samples);
+    calc_and_print_stat(os, m_samples);
 }
 
 void one_side_asm_test::one_work() noexcept {
@@ -171,17 +283,17 @@ void one_side_asm_test::one_work() noexcept {
 
     while (true) {
         do {
-            if (cont = m_continue.load(std::memory_order_relaxed); cont < 0)
+            if (cont = m_continue->load(std::memory_order_relaxed); cont < 0)
                 return;
         } while (cont == 0);
 
-        m_continue.store(0, std::memory_order_relaxed);
+        m_continue->store(0, std::memory_order_relaxed);
 
         // give a chance for another side to prepare for waiting the data change
         for (int i = 0; i < s_warmup_cycles; ++i)
             code_barrier();
 
-        *start_cycle = produce_and_get_cycles(data_sample);
+        *start_cycle = produce_and_get_cycles(*m_data, data_sample);
 
         code_barrier();
 
@@ -195,14 +307,14 @@ void one_side_asm_test::another_work() noexcept {
     std::uint32_t data_sample = 1;
 
     for (std::uint32_t attempt = 0; attempt < m_config.m_attempts_count; ++attempt) {
-        m_continue.store(1, std::memory_order_relaxed);
+        m_continue->store(1, std::memory_order_relaxed);
 
         std::uint32_t v;
         do {
             // it's possible to get [end_cycle] < [start_cycle] in rare cases because it's read
             // before test data is checked. The logic here is to eliminate duration of the rdtsc
             // call in average.
-            *end_cycle = consume_and_get_cycles(v);
+            *end_cycle = consume_and_get_cycles(*m_data, v);
         }
         while (v != data_sample);
 
@@ -212,7 +324,7 @@ void one_side_asm_test::another_work() noexcept {
         ++data_sample;
     }
 
-    m_continue.store(-1);
+    m_continue->store(-1);
 }
 
 void one_side_asm_relax_branch_pred_test::another_work() noexcept {
@@ -220,7 +332,7 @@ void one_side_asm_relax_branch_pred_test::another_work() noexcept {
     std::uint32_t data_sample = 1;
 
     for (std::uint32_t attempt = 0; attempt < m_config.m_attempts_count; ++attempt) {
-        m_continue.store(1, std::memory_order_relaxed);
+        m_continue->store(1, std::memory_order_relaxed);
 
         // it's possible to get [end_cycle] < [start_cycle] in rare cases because it's read before
         // test data is checked. The logic here is to eliminate duration of the rdtsc call in
@@ -228,7 +340,7 @@ void one_side_asm_relax_branch_pred_test::another_work() noexcept {
         // Moreover it's possible to not find the expected test data state in case of this thread
         // was freezed unexpectedly.
         for (auto& sample : m_samples)
-            sample.second = consume_and_get_cycles(sample.first);
+            sample.second = consume_and_get_cycles(*m_data, sample.first);
 
         code_barrier();
 
@@ -240,17 +352,123 @@ void one_side_asm_relax_branch_pred_test::another_work() noexcept {
         ++data_sample;
     }
 
-    m_continue.store(-1);
+    m_continue->store(-1);
+}
+
+
+void wake_from_idle_test::idle() const noexcept {
+    if (m_config.m_idle_kind == idle_kind::sleep) {
+        timespec ts{static_cast<time_t>(m_config.m_idle_us / 1000000),
+            static_cast<long>(m_config.m_idle_us % 1000000 * 1000)};
+        while (nanosleep(&ts, &ts) != 0)
+            ;
+    } else {
+        const auto until = std::chrono::steady_clock::now() + std::chrono::microseconds{m_config.m_idle_us};
+        while (std::chrono::steady_clock::now() < until)
+            for (int i = 0; i < 100; ++i)
+                __builtin_ia32_pause();
+    }
+}
+
+void wake_from_idle_test::one_work() noexcept {
+    std::int8_t cont;
+    std::uint32_t data_sample = 1;
+    auto start_cycle = &m_start_cycles[0];
+
+    while (true) {
+        do {
+            if (cont = m_continue->load(std::memory_order_relaxed); cont < 0)
+                return;
+        } while (cont == 0);
+
+        m_continue->store(0, std::memory_order_relaxed);
+
+        // no warm up here: another side starts waiting right after it says to continue, and
+        // letting it spin longer would warm its core up
+        *start_cycle = rdtsc();
+        m_data->store(data_sample, std::memory_order_relaxed);
+
+        code_barrier();
+
+        ++start_cycle;
+        ++data_sample;
+    }
+}
+
+void wake_from_idle_test::another_work() noexcept {
+    auto end_cycle = &m_end_cycles[0];
+    std::uint32_t data_sample = 1;
+
+    for (std::uint32_t attempt = 0; attempt < m_config.m_attempts_count; ++attempt) {
+        idle();
+
+        m_continue->store(1, std::memory_order_relaxed);
+
+        while (m_data->load(std::memory_order_relaxed) != data_sample)
+            ;
+
+        *end_cycle = rdtsc();
+        ++end_cycle;
+
+        ++data_sample;
+    }
+
+    m_continue->store(-1);
+}
+
+void wake_from_idle_test::report(std::ostream& os) {
+    os << "  idle         : " << m_config.m_idle_us << " us in "
+        << (m_config.m_idle_kind == idle_kind::sleep ? "nanosleep" : "pause loop") << " before every attempt\n";
+    one_side_test::report(os);
+}
+
+void latency_probe_test::set_config(const config& cfg) {
+    m_config = cfg;
+    const auto slot_size = m_config.m_memory.m_slot_size;
+    m_arena = memory_arena{(sizeof(latency_probe) + slot_size - 1) / slot_size + 1, m_config.m_memory};
+    m_probe = m_arena.create<latency_probe>(s_period_cycles);
+    m_stop = m_arena.create<std::atomic<bool>>(false);
+}
+
+void latency_probe_test::one_work() noexcept {
+    while (! m_stop->load(std::memory_order_relaxed))
+        m_probe->send();
+}
+
+void latency_probe_test::another_work() noexcept {
+    for (std::uint32_t attempt = 0; attempt < m_config.m_attempts_count; )
+        if (m_probe->receive())
+            ++attempt;
+    m_stop->store(true, std::memory_order_relaxed);
+}
+
+void latency_probe_test::report(std::ostream& os) {
+    const auto snapshot = m_probe->snapshot();
+    const auto ghz = get_cpu_freq_ghz();
+
+    os << "  measures     : " << snapshot.m_count;
+    for (auto q : {0.5, 0.9, 0.99, 0.999}) {
+        const auto cycles = snapshot.quantile(q);
+        os << "\n  cycles p" << std::left << std::setw(5) << q * 100 << std::right << ": <= " << cycles
+            << " (" << static_cast<double>(cycles) / ghz << "ns)";
+    }
 }
 
+void ping_pong_test::set_config(const config& cfg) {
+    m_config = cfg;
+    m_arena = memory_arena{1, m_config.m_memory};
+    m_data = m_arena.create<std::atomic<std::uint32_t>>(0);
+    m_samples.clear();
+    m_collected = false;
+}
 
 void ping_pong_test::one_work() noexcept {
     for (auto& cycles_on_attempt : m_cycles) {
-        g_test_data.store(0, std::memory_order_relaxed);
+        m_data->store(0, std::memory_order_relaxed);
         cycles_on_attempt = rdtsc();
         for (std::uint32_t i = 0; i < s_ping_pongs; ++i) {
             std::uint32_t v = i;
-            while (! g_test_data.compare_exchange_strong(v, i+1, std::memory_order_relaxed, std::memory_order_relaxed))
+            while (! m_data->compare_exchange_strong(v, i+1, std::memory_order_relaxed, std::memory_order_relaxed))
                 v = i;
             ++i;
         }
@@ -262,19 +480,722 @@ void ping_pong_test::another_work() noexcept {
     for (auto attempt = m_cycles.size(); attempt != 0; --attempt) {
         for (std::uint32_t i = 1; i < s_ping_pongs - 1; ++i) {
             std::uint32_t v = i;
-            while (! g_test_data.compare_exchange_strong(v, i+1, std::memory_order_relaxed, std::memory_order_relaxed))
+            while (! m_data->compare_exchange_strong(v, i+1, std::memory_order_relaxed, std::memory_order_relaxed))
                 v = i;
             ++i;
         }
     }
 }
 
+const std::vector<double>* ping_pong_test::collect_samples() {
+    if (m_collected)
+        return &m_samples;
+    m_collected = true;
+
+    m_samples.reserve(m_samples.size() + m_cycles.size());
+    for (std::size_t i = 0; i < m_cycles.size(); ++i)
+        m_samples.push_back(static_cast<double>(m_cycles[i]) / s_ping_pongs);
+
+    return &m_samples;
+}
+
 void ping_pong_test::report(std::ostream& os) {
+    collect_samples();
+    calc_and_print_stat(os, m_samples);
+}
+
+template <template <typename> class Queue>
+void mpmc_queue_test<Queue>::set_config(const config& cfg) {
+    m_config = cfg;
+    m_queue = std::make_unique<queue_t>(s_queue_capacity);
+    m_workers = std::vector<worker_data>(workers_count());
+}
+
+template <template <typename> class Queue>
+void mpmc_queue_test<Queue>::prepare(std::size_t worker_idx) {
+    auto& data = m_workers[worker_idx];
+    if (worker_idx < m_config.m_producers) {
+        // a producer may be the last one which pushes stop items for all the consumers
+        if constexpr (std::is_same_v<queue_t, list_mpmc_queue<item>>)
+            data.m_nodes.reset(new typename queue_t::node[m_config.m_attempts_count + m_config.m_consumers]);
+    } else
+        allocate_samples(data.m_latencies,
+            std::size_t{m_config.m_attempts_count} * m_config.m_producers, m_config.m_samples_memory);
+}
+
+template <template <typename> class Queue>
+void mpmc_queue_test<Queue>::produce(worker_data& data, const item& it) noexcept {
+    if constexpr (std::is_same_v<queue_t, list_mpmc_queue<item>>) {
+        auto& n = data.m_nodes[data.m_next_node++];
+        n.m_data = it;
+        m_queue->push(&n);
+    } else {
+        while (! m_queue->try_push(it))
+            ;
+    }
+}
+
+template <template <typename> class Queue>
+void mpmc_queue_test<Queue>::work(std::size_t worker_idx) noexcept {
+    auto& data = m_workers[worker_idx];
+
+    if (worker_idx < m_config.m_producers) {
+        data.m_first_cycles = rdtsc();
+        for (std::uint32_t attempt = 0; attempt < m_config.m_attempts_count; ++attempt)
+            produce(data, item{rdtsc(), worker_idx});
+
+        // the queue keeps FIFO order, so consumers get stop items only after all the real ones
+        if (m_producers_done.fetch_add(1, std::memory_order_acq_rel) + 1u == m_config.m_producers)
+            for (std::uint16_t i = 0; i < m_config.m_consumers; ++i)
+                produce(data, item{0, worker_idx});
+        return;
+    }
+
+    auto latency = &data.m_latencies[0];
+    item it;
+    while (true) {
+        if (! m_queue->try_pop(it))
+            continue;
+
+        const auto end_cycles = rdtsc();
+        if (it.m_cycles == 0)
+            break;
+
+        *latency++ = end_cycles - it.m_cycles;
+        data.m_last_cycles = end_cycles;
+    }
+    data.m_count = latency - &data.m_latencies[0];
+}
+
+template <template <typename> class Queue>
+std::vector<double> mpmc_queue_test<Queue>::collect_samples() const {
+    std::vector<double> res;
+    for (std::size_t i = m_config.m_producers; i < m_workers.size(); ++i)
+        for (std::size_t j = 0; j < m_workers[i].m_count; ++j)
+            res.push_back(static_cast<double>(m_workers[i].m_latencies[j]));
+    return res;
+}
+
+template <template <typename> class Queue>
+void mpmc_queue_test<Queue>::report(std::ostream& os) {
+    auto samples = collect_samples();
+    std::uint64_t first_cycles = std::numeric_limits<std::uint64_t>::max(), last_cycles = 0;
+
+    for (std::size_t i = 0; i < m_workers.size(); ++i) {
+        const auto& data = m_workers[i];
+        if (i < m_config.m_producers)
+            first_cycles = std::min(first_cycles, data.m_first_cycles);
+        else
+            last_cycles = std::max(last_cycles, data.m_last_cycles);
+    }
+
+    const auto cpufreq_ghz = get_cpu_freq_ghz();
+    const auto duration_ns = static_cast<double>(last_cycles - first_cycles) / cpufreq_ghz;
+
+    os <<
+        "  producers    : " << m_config.m_producers << "\n"
+        "  consumers    : " << m_config.m_consumers << "\n"
+        "  throughput   : " << samples.size() / duration_ns * 1000.0 << " Mops/s\n"
+        "  latency:\n";
+    calc_and_print_stat(os, samples);
+}
+
+template class mpmc_queue_test<bounded_mpmc_queue>;
+template class mpmc_queue_test<list_mpmc_queue>;
+
+void seqlock_test::set_config(const config& cfg) {
+    m_config = cfg;
+    const auto& memory = m_config.m_memory;
+    m_arena = memory_arena{1 + memory_arena::slots(sizeof(record_line) * m_config.m_record_lines, memory), memory};
+    m_sequence = m_arena.create<std::atomic<std::uint64_t>>(0);
+    m_record = m_arena.create_array<record_line>(m_config.m_record_lines);
+    m_stop.store(false, std::memory_order_relaxed);
+    m_readers = std::vector<reader_data>(m_config.m_readers);
+}
+
+void seqlock_test::prepare(std::size_t worker_idx) {
+    if (worker_idx == 0)
+        allocate_samples(m_update_cycles, m_config.m_attempts_count, m_config.m_samples_memory);
+    else
+        allocate_samples(m_readers[worker_idx - 1].m_latencies,
+            std::size_t{m_config.m_attempts_count} * s_reads_per_update, m_config.m_samples_memory);
+}
+
+void seqlock_test::work(std::size_t worker_idx) noexcept {
+    if (worker_idx == 0) {
+        auto update_cycles = &m_update_cycles[0];
+
+        for (std::uint32_t attempt = 1; attempt <= m_config.m_attempts_count; ++attempt) {
+            for (int i = 0; i < s_pause_cycles; ++i)
+                code_barrier();
+
+            const auto start_cycles = rdtsc();
+            const auto seq = m_sequence->load(std::memory_order_relaxed);
+            m_sequence->store(seq + 1, std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_release);
+
+            for (std::size_t i = 0; i < m_config.m_record_lines; ++i)
+                for (auto& word : m_record[i].m_words)
+                    word.store(attempt, std::memory_order_relaxed);
+
+            m_sequence->store(seq + 2, std::memory_order_release);
+            *update_cycles++ = rdtsc() - start_cycles;
+        }
+
+        m_stop.store(true, std::memory_order_relaxed);
+        return;
+    }
+
+    auto& data = m_readers[worker_idx - 1];
+    const auto capacity = data.m_latencies.size();
+    // the buffer is filled early in the run while reads go on until the writer finishes, so it
+    // keeps a reservoir sample (Algorithm R) of all the reads; xorshift is enough and is cheap
+    std::uint64_t random = 0x9e3779b97f4a7c15ull + worker_idx;
+
+    while (! m_stop.load(std::memory_order_relaxed)) {
+        const auto start_cycles = rdtsc();
+        bool waited = false;
+
+        while (true) {
+            const auto seq = m_sequence->load(std::memory_order_acquire);
+            if (seq & 1) {
+                // not a retry: nothing is read until the writer finishes
+                waited = true;
+                continue;
+            }
+
+            for (std::size_t i = 0; i < m_config.m_record_lines; ++i)
+                for (auto& word : m_record[i].m_words)
+                    word.load(std::memory_order_relaxed);
+
+            std::atomic_thread_fence(std::memory_order_acquire);
+            if (m_sequence->load(std::memory_order_relaxed) == seq)
+                break;
+            ++data.m_retries;
+        }
+
+        const auto end_cycles = rdtsc();
+        auto idx = data.m_reads++;
+        data.m_waits += waited;
+        if (idx >= capacity) {
+            random ^= random << 13;
+            random ^= random >> 7;
+            random ^= random << 17;
+            // uniform in [0, reads) without a division
+            idx = static_cast<std::uint64_t>((static_cast<unsigned __int128>(random) * data.m_reads) >> 64);
+        }
+        if (idx < capacity)
+            data.m_latencies[idx] = end_cycles - start_cycles;
+    }
+    data.m_count = std::min<std::uint64_t>(data.m_reads, capacity);
+}
+
+std::vector<double> seqlock_test::collect_samples() const {
+    std::vector<double> res;
+    for (const auto& data : m_readers)
+        for (std::size_t i = 0; i < data.m_count; ++i)
+            res.push_back(static_cast<double>(data.m_latencies[i]));
+    return res;
+}
+
+void seqlock_test::report(std::ostream& os) {
     std::vector<double> samples;
+    std::uint64_t reads = 0, retries = 0, waits = 0;
 
-    samples.reserve(m_cycles.size());
-    for (std::size_t i = 0; i < m_cycles.size(); ++i)
-        samples.push_back(static_cast<double>(m_cycles[i]) / s_ping_pongs);
+    samples.reserve(m_update_cycles.size());
+    for (auto cycles : m_update_cycles)
+        samples.push_back(static_cast<double>(cycles));
 
+    os <<
+        "  record lines : " << m_config.m_record_lines << "\n"
+        "  readers      : " << m_config.m_readers << "\n"
+        "  writer update:\n";
     calc_and_print_stat(os, samples);
+
+    samples = collect_samples();
+    for (const auto& data : m_readers) {
+        reads += data.m_reads;
+        retries += data.m_retries;
+        waits += data.m_waits;
+    }
+
+    os << "\n  reader successful read";
+    if (samples.size() < reads)
+        os << " (" << samples.size() << " of " << reads << " reads sampled at random)";
+    os << ":\n";
+    calc_and_print_stat(os, samples);
+    os << "\n  retries per read: " << (reads ? static_cast<double>(retries) / reads : 0.0)
+        << "\n  reads waiting for the writer: " << (reads ? static_cast<double>(waits) / reads * 100 : 0.0) << "%";
+}
+
+void broadcast_ring_test::set_config(const config& cfg) {
+    m_config = cfg;
+    const auto& memory = m_config.m_memory;
+    m_arena = memory_arena{1 + memory_arena::slots(sizeof(slot) * s_ring_size, memory) + m_config.m_consumers,
+        memory};
+    m_published = m_arena.create<std::atomic<std::uint64_t>>(0);
+    m_ring = m_arena.create_array<slot>(s_ring_size);
+    m_cursors.clear();
+    for (std::size_t i = 0; i < m_config.m_consumers; ++i)
+        m_cursors.push_back(m_arena.create<cursor>());
+    m_consumers = std::vector<consumer_data>(m_config.m_consumers);
+    m_gating_stalls = 0;
+}
+
+void broadcast_ring_test::prepare(std::size_t worker_idx) {
+    if (worker_idx == 0)
+        allocate_samples(m_gating_cycles, m_config.m_attempts_count, m_config.m_samples_memory);
+    else
+        allocate_samples(m_consumers[worker_idx - 1].m_latencies, m_config.m_attempts_count,
+            m_config.m_samples_memory);
+}
+
+void broadcast_ring_test::work(std::size_t worker_idx) noexcept {
+    const std::uint64_t events = m_config.m_attempts_count;
+
+    if (worker_idx == 0) {
+        auto gating_cycles = &m_gating_cycles[0];
+
+        for (std::uint64_t event = 0; event < events; ++event) {
+            for (int i = 0; i < s_pause_cycles; ++i)
+                code_barrier();
+
+            const auto start_cycles = rdtsc();
+            bool stalled = false;
+            while (true) {
+                auto slowest = event;
+                for (std::size_t i = 0; i < m_config.m_consumers; ++i)
+                    slowest = std::min(slowest, m_cursors[i]->m_value.load(std::memory_order_acquire));
+                if (event - slowest < s_ring_size)
+                    break;
+                stalled = true;
+            }
+            *gating_cycles++ = rdtsc() - start_cycles;
+            m_gating_stalls += stalled;
+
+            m_ring[event % s_ring_size].m_cycles = rdtsc();
+            m_published->store(event + 1, std::memory_order_release);
+        }
+        return;
+    }
+
+    auto& data = m_consumers[worker_idx - 1];
+    auto& consumed = m_cursors[worker_idx - 1]->m_value;
+    std::uint64_t event = 0;
+
+    while (event < events) {
+        std::uint64_t published;
+        while ((published = m_published->load(std::memory_order_acquire)) <= event)
+            ;
+
+        for (; event < published; ++event)
+            data.m_latencies[event] = rdtsc() - m_ring[event % s_ring_size].m_cycles;
+
+        consumed.store(event, std::memory_order_release);
+    }
+}
+
+std::vector<double> broadcast_ring_test::collect_samples() const {
+    std::vector<double> res;
+    for (const auto& data : m_consumers)
+        for (auto cycles : data.m_latencies)
+            res.push_back(static_cast<double>(cycles));
+    return res;
+}
+
+void broadcast_ring_test::report(std::ostream& os) {
+    std::vector<double> samples;
+
+    samples.reserve(m_gating_cycles.size());
+    for (auto cycles : m_gating_cycles)
+        samples.push_back(static_cast<double>(cycles));
+
+    os <<
+        "  consumers    : " << m_config.m_consumers << "\n"
+        "  writer stalls: " << m_gating_stalls << " events waited for consumers\n"
+        "  writer gating:\n";
+    calc_and_print_stat(os, samples);
+
+    for (std::size_t i = 0; i < m_consumers.size(); ++i) {
+        samples.clear();
+        for (auto cycles : m_consumers[i].m_latencies)
+            samples.push_back(static_cast<double>(cycles));
+
+        os << "\n  consumer " << i + 1 << " (worker " << i + 2 << "):\n";
+        calc_and_print_stat(os, samples);
+    }
+}
+
+template <counter_sharding Sharding>
+void sharded_counter_test<Sharding>::set_config(const config& cfg) {
+    m_config = cfg;
+    m_arenas.clear();
+    m_shards.clear();
+    if constexpr (Sharding == counter_sharding::per_numa_node) {
+        // memory can't be bound to memoryless nodes, so they have no shards; if the nodes aren't
+        // known there is a single shard placed as configured
+        m_shard_nodes.clear();
+        for (auto node : numa_memory_nodes())
+            m_shard_nodes.push_back(static_cast<int>(node));
+        if (m_shard_nodes.empty())
+            m_shard_nodes.push_back(m_config.m_memory.m_numa_node);
+        m_shards_count = m_shard_nodes.size();
+
+        for (auto node : m_shard_nodes) {
+            auto opts = m_config.m_memory;
+            opts.m_numa_node = node;
+            m_shards.push_back(m_arenas.emplace_back(1, opts).template create<shard>());
+        }
+    } else {
+        m_shards_count = Sharding == counter_sharding::none ? 1 : m_config.m_incrementers;
+        auto& arena = m_arenas.emplace_back(m_shards_count, m_config.m_memory);
+        for (std::size_t i = 0; i < m_shards_count; ++i)
+            m_shards.push_back(arena.create<shard>());
+    }
+
+    m_incrementers = std::vector<incrementer_data>(m_config.m_incrementers);
+}
+
+template <counter_sharding Sharding>
+void sharded_counter_test<Sharding>::prepare(std::size_t worker_idx) {
+    if (worker_idx == 0) {
+        allocate_samples(m_read_cycles, m_config.m_attempts_count, m_config.m_samples_memory);
+        return;
+    }
+
+    auto& data = m_incrementers[worker_idx - 1];
+    if constexpr (Sharding == counter_sharding::none)
+        data.m_shard = m_shards[0];
+    else if constexpr (Sharding == counter_sharding::per_core)
+        data.m_shard = m_shards[worker_idx - 1];
+    else {
+        // the worker is already bound to its CPU core, a CPU of a node without a shard uses the
+        // shard of the nearest node (the first one if distances aren't known)
+        auto cpuid = sched_getcpu();
+        auto node = cpuid < 0 ? -1 : cpu_numa_node(static_cast<unsigned>(cpuid));
+        std::size_t nearest = 0;
+        int nearest_distance = std::numeric_limits<int>::max();
+        for (std::size_t i = 0; i < m_shards_count; ++i) {
+            if (m_shard_nodes[i] == node) {
+                nearest = i;
+                break;
+            }
+            const auto distance = node < 0 || m_shard_nodes[i] < 0 ? -1
+                : numa_distance(static_cast<unsigned>(node), static_cast<unsigned>(m_shard_nodes[i]));
+            if (distance >= 0 && distance < nearest_distance) {
+                nearest = i;
+                nearest_distance = distance;
+            }
+        }
+        data.m_shard = m_shards[nearest];
+    }
+}
+
+template <counter_sharding Sharding>
+void sharded_counter_test<Sharding>::work(std::size_t worker_idx) noexcept {
+    if (worker_idx == 0) {
+        for (auto& read_cycles : m_read_cycles) {
+            for (int i = 0; i < s_read_period_cycles; ++i)
+                code_barrier();
+
+            const auto start_cycles = rdtsc();
+            std::uint64_t value = 0;
+            for (std::size_t i = 0; i < m_shards_count; ++i)
+                value += m_shards[i]->m_value.load(std::memory_order_relaxed);
+            read_cycles = rdtsc() - start_cycles;
+        }
+
+        m_stop.store(true, std::memory_order_relaxed);
+        return;
+    }
+
+    auto& data = m_incrementers[worker_idx - 1];
+    auto& value = data.m_shard->m_value;
+    std::uint64_t increments = 0;
+
+    data.m_start_cycles = rdtsc();
+    while (! m_stop.load(std::memory_order_relaxed)) {
+        if constexpr (Sharding == counter_sharding::per_core)
+            // the only writer of the shard doesn't need an atomic read-modify-write operation
+            value.store(value.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+        else
+            value.fetch_add(1, std::memory_order_relaxed);
+        ++increments;
+    }
+    data.m_end_cycles = rdtsc();
+    data.m_increments = increments;
+}
+
+template <counter_sharding Sharding>
+std::vector<double> sharded_counter_test<Sharding>::collect_samples() const {
+    std::vector<double> res;
+    res.reserve(m_read_cycles.size());
+    for (auto cycles : m_read_cycles)
+        res.push_back(static_cast<double>(cycles));
+    return res;
+}
+
+template <counter_sharding Sharding>
+void sharded_counter_test<Sharding>::report(std::ostream& os) {
+    auto samples = collect_samples();
+    std::uint64_t increments = 0, counted = 0;
+    double increments_per_ns = 0.0;
+    const auto cpufreq_ghz = get_cpu_freq_ghz();
+
+    for (const auto& data : m_incrementers) {
+        increments += data.m_increments;
+        increments_per_ns += data.m_increments * cpufreq_ghz / (data.m_end_cycles - data.m_start_cycles);
+    }
+    for (std::size_t i = 0; i < m_shards_count; ++i)
+        counted += m_shards[i]->m_value.load(std::memory_order_relaxed);
+
+    os <<
+        "  incrementers : " << m_config.m_incrementers << "\n"
+        "  shards       : " << m_shards_count << "\n"
+        "  increments   : " << increments << (increments == counted ? "" : " (counter value mismatch)") << "\n"
+        "  throughput   : " << increments_per_ns * 1000.0 << " Mops/s\n"
+        "  counter read:\n";
+    calc_and_print_stat(os, samples);
+}
+
+template class sharded_counter_test<counter_sharding::none>;
+template class sharded_counter_test<counter_sharding::per_core>;
+template class sharded_counter_test<counter_sharding::per_numa_node>;
+
+void memory_ordering_test::set_config(const config& cfg) {
+    m_config = cfg;
+    m_arena = memory_arena{2, m_config.m_memory};
+    m_data = m_arena.create<std::atomic<std::uint32_t>>(0);
+    m_continue = m_arena.create<std::atomic<std::int8_t>>(0);
+}
+
+template <int Variant>
+void memory_ordering_test::one_work_variant(std::uint32_t& data_sample) noexcept {
+    constexpr auto kind = static_cast<store_kind>(Variant);
+    std::int8_t cont;
+    auto start_cycle = &m_start_cycles[Variant * m_config.m_attempts_count];
+
+    while (true) {
+        do {
+            if (cont = m_continue->load(std::memory_order_relaxed); cont < 0)
+                break;
+        } while (cont == 0);
+
+        if (cont < 0)
+            break;
+
+        m_continue->store(0, std::memory_order_relaxed);
+
+        for (int i = 0; i < s_warmup_cycles; ++i)
+            code_barrier();
+
+        *start_cycle = rdtsc();
+        store_data<kind>(*m_data, data_sample);
+
+        code_barrier();
+
+        ++start_cycle;
+        ++data_sample;
+    }
+
+    // the other side sets the flag only after the ping pong below is finished
+    m_continue->store(0, std::memory_order_relaxed);
+
+    for (auto cycles = &m_ping_pong_cycles[Variant * m_config.m_attempts_count],
+            end = cycles + m_config.m_attempts_count; cycles != end; ++cycles) {
+        m_data->store(0, std::memory_order_relaxed);
+        *cycles = rdtsc();
+        for (std::uint32_t i = 0; i < s_ping_pongs; i += 2)
+            exchange_data<kind>(*m_data, i, i + 1);
+        *cycles = rdtsc() - *cycles;
+    }
+
+    if constexpr (Variant + 1 < s_variants)
+        one_work_variant<Variant + 1>(data_sample);
+}
+
+template <int Variant>
+void memory_ordering_test::another_work_variant(std::uint32_t& data_sample) noexcept {
+    constexpr auto kind = static_cast<store_kind>(Variant);
+    auto end_cycle = &m_end_cycles[Variant * m_config.m_attempts_count];
+
+    for (std::uint32_t attempt = 0; attempt < m_config.m_attempts_count; ++attempt) {
+        m_continue->store(1, std::memory_order_relaxed);
+
+        while (load_data<kind>(*m_data) != data_sample)
+            ;
+
+        *end_cycle++ = rdtsc();
+
+        ++data_sample;
+    }
+
+    m_continue->store(-1, std::memory_order_relaxed);
+
+    for (auto attempt = m_config.m_attempts_count; attempt != 0; --attempt)
+        for (std::uint32_t i = 1; i < s_ping_pongs - 1; i += 2)
+            exchange_data<kind>(*m_data, i, i + 1);
+
+    if constexpr (Variant + 1 < s_variants)
+        another_work_variant<Variant + 1>(data_sample);
+}
+
+void memory_ordering_test::one_work() noexcept {
+    std::uint32_t data_sample = s_first_sample;
+    one_work_variant<0>(data_sample);
+}
+
+void memory_ordering_test::another_work() noexcept {
+    std::uint32_t data_sample = s_first_sample;
+    another_work_variant<0>(data_sample);
+}
+
+void memory_ordering_test::report(std::ostream& os) {
+    static constexpr const char* variant_names[s_variants] =
+        {"relaxed", "release/acquire", "seq_cst", "relaxed+mfence", "relaxed+sfence", "relaxed+lock add"};
+
+    const auto cpufreq_ghz = get_cpu_freq_ghz();
+    const auto attempts = m_config.m_attempts_count;
+    double one_side_base = 0.0, ping_pong_base = 0.0;
+
+    os << "  freq, GHz    : " << cpufreq_ghz << "\n"
+        "  measures     : " << attempts << "\n"
+        "  median cycles of a hand-off and the addition to relaxed ordering:\n"
+        "  " << std::left << std::setw(18) << "variant" << std::setw(36) << "one side"
+        << " ping pong" << std::right;
+
+    for (std::size_t variant = 0; variant < s_variants; ++variant) {
+        std::vector<double> one_side, ping_pong;
+        for (std::size_t i = variant * attempts; i < (variant + 1) * attempts; ++i) {
+            one_side.push_back(static_cast<double>(m_end_cycles[i]) - static_cast<double>(m_start_cycles[i]));
+            ping_pong.push_back(static_cast<double>(m_ping_pong_cycles[i]) / s_ping_pongs);
+        }
+
+        const auto one_side_median = median(one_side);
+        const auto ping_pong_median = median(ping_pong);
+        if (variant == 0) {
+            one_side_base = one_side_median;
+            ping_pong_base = ping_pong_median;
+        }
+
+        std::ostringstream one_side_col, ping_pong_col;
+        one_side_col << one_side_median << " (" << std::showpos << one_side_median - one_side_base
+            << ", " << (one_side_median - one_side_base) / cpufreq_ghz << "ns)";
+        ping_pong_col << ping_pong_median << " (" << std::showpos << ping_pong_median - ping_pong_base
+            << ", " << (ping_pong_median - ping_pong_base) / cpufreq_ghz << "ns)";
+
+        os << "\n  " << std::left << std::setw(18) << variant_names[variant]
+            << std::setw(36) << one_side_col.str() << ' ' << ping_pong_col.str() << std::right;
+    }
+}
+
+void store_fence_test::set_config(const config& cfg) {
+    m_config = cfg;
+    m_arena = memory_arena{2, m_config.m_memory};
+    m_data = m_arena.create<std::atomic<std::uint32_t>>(0);
+    m_continue = m_arena.create<std::atomic<std::int8_t>>(0);
+}
+
+template <int Variant>
+void store_fence_test::one_work_variant(std::uint32_t& data_sample) noexcept {
+    constexpr store_kind kinds[s_variants] =
+        {store_kind::relaxed, store_kind::mfence, store_kind::sfence, store_kind::locked, store_kind::xchg};
+    std::int8_t cont;
+    auto start_cycle = &m_start_cycles[Variant * m_config.m_attempts_count];
+    auto fenced_cycle = &m_fenced_cycles[Variant * m_config.m_attempts_count];
+
+    while (true) {
+        do {
+            if (cont = m_continue->load(std::memory_order_relaxed); cont < 0)
+                break;
+        } while (cont == 0);
+
+        if (cont < 0)
+            break;
+
+        m_continue->store(0, std::memory_order_relaxed);
+
+        for (int i = 0; i < s_warmup_cycles; ++i)
+            code_barrier();
+
+        // the other side spins on the data, so the cache line is owned by its core at this point
+        *start_cycle = rdtsc();
+        store_data<kinds[Variant]>(*m_data, data_sample);
+        *fenced_cycle = rdtsc_ordered();
+
+        ++start_cycle;
+        ++fenced_cycle;
+        ++data_sample;
+    }
+
+    // the other side sets the flag for the next variant only after waiting for this store
+    m_continue->store(0, std::memory_order_relaxed);
+    m_data->store(0, std::memory_order_relaxed);
+
+    if constexpr (Variant + 1 < s_variants)
+        one_work_variant<Variant + 1>(data_sample);
+}
+
+void store_fence_test::one_work() noexcept {
+    std::uint32_t data_sample = 1;
+    one_work_variant<0>(data_sample);
+}
+
+void store_fence_test::another_work() noexcept {
+    auto end_cycle = &m_end_cycles[0];
+    std::uint32_t data_sample = 1;
+
+    for (int variant = 0; variant < s_variants; ++variant) {
+        for (std::uint32_t attempt = 0; attempt < m_config.m_attempts_count; ++attempt) {
+            m_continue->store(1, std::memory_order_relaxed);
+
+            while (m_data->load(std::memory_order_relaxed) != data_sample)
+                ;
+
+            *end_cycle++ = rdtsc();
+
+            ++data_sample;
+        }
+
+        m_continue->store(-1, std::memory_order_relaxed);
+        while (m_data->load(std::memory_order_relaxed) != 0)
+            ;
+    }
+}
+
+void store_fence_test::report(std::ostream& os) {
+    static constexpr const char* variant_names[s_variants] =
+        {"no fence", "mfence", "sfence", "lock add", "xchg"};
+
+    const auto cpufreq_ghz = get_cpu_freq_ghz();
+    const auto attempts = m_config.m_attempts_count;
+    double visibility_base = 0.0;
+
+    os << "  freq, GHz    : " << cpufreq_ghz << "\n"
+        "  measures     : " << attempts << "\n"
+        "  median cycles of a store becoming visible to the other core and of the store with the\n"
+        "  fence executed locally:\n"
+        "  " << std::left << std::setw(12) << "variant" << std::setw(36) << "visibility"
+        << " local" << std::right;
+
+    for (std::size_t variant = 0; variant < s_variants; ++variant) {
+        std::vector<double> visibility, local;
+        for (std::size_t i = variant * attempts; i < (variant + 1) * attempts; ++i) {
+            visibility.push_back(static_cast<double>(m_end_cycles[i]) - static_cast<double>(m_start_cycles[i]));
+            local.push_back(static_cast<double>(m_fenced_cycles[i]) - static_cast<double>(m_start_cycles[i]));
+        }
+
+        const auto visibility_median = median(visibility);
+        const auto local_median = median(local);
+        if (variant == 0)
+            visibility_base = visibility_median;
+
+        std::ostringstream visibility_col, local_col;
+        visibility_col << visibility_median << " (" << std::showpos << visibility_median - visibility_base
+            << ", " << (visibility_median - visibility_base) / cpufreq_ghz << "ns)";
+        local_col << local_median << " (" << local_median / cpufreq_ghz << "ns)";
+
+        os << "\n  " << std::left << std::setw(12) << variant_names[variant]
+            << std::setw(36) << visibility_col.str() << ' ' << local_col.str() << std::right;
+    }
 }
@@ -1,13 +1,27 @@
 // vim: textwidth=100
 #pragma once
 
+#include "memory.h"
+#include "latency_probe.h"
+#include "queues.h"
+#include "sample_dump.h"
+
 #include <cstdint>
 #include <cstddef>
 #include <atomic>
+#include <memory>
 #include <vector>
 #include <utility>
 #include <iosfwd>
 
+// how the receiver of the wake from idle test spends its idle period
+enum class idle_kind {
+    // nanosleep() letting the kernel put the core into a C-state
+    sleep,
+    // spinning on the pause instruction keeping the core awake but not busy
+    pause
+};
+
 /*
  * A test case consists of two sequences run in separate threads bound to specified CPU cores.
  * Every sequence consists of two parts: preparation and the main part ( dance:) ). Before
@@ -17,6 +31,23 @@
 struct test_case_iface {
     struct config {
         std::uint32_t m_attempts_count = 1000;
+        // used by the tests having several workers on every side
+        std::uint16_t m_producers = 1;
+        std::uint16_t m_consumers = 1;
+        std::uint16_t m_readers = 1;
+        std::uint16_t m_incrementers = 1;
+        // size of a record shared between workers, in cache lines
+        std::uint16_t m_record_lines = 1;
+        // where the data exchanged by workers of the two-sided tests is placed
+        memory_arena::options m_memory;
+        // where samples collected by workers are placed
+        mapping_options m_samples_memory;
+        // minimal gap in cycles between TSC readings in a tight loop considered as an interruption
+        // of a worker, zero disables the detection, it's made by mode 0 only
+        std::uint64_t m_jitter_threshold = 0;
+        // idle period of the receiver before every attempt of the wake from idle test
+        std::uint32_t m_idle_us = 100;
+        idle_kind m_idle_kind = idle_kind::sleep;
     };
 
     virtual ~test_case_iface() = default;
@@ -31,6 +62,85 @@ struct test_case_iface {
     virtual void another_work() noexcept = 0;
     // say what you want to say at the end
     virtual void report(std::ostream& os) = 0;
+    // Collects latency samples in cycles taken by the last run of the main dance and returns all
+    // the samples collected since set_config(), the report covers all of them. A test case which
+    // provides samples can be run repeatedly until their percentiles are estimated precisely
+    // enough, the preparation steps are repeated before every run.
+    virtual const std::vector<double>* collect_samples() { return nullptr; }
+    // Replaces the samples collected so far, e.g. by a subset of them to bound memory of a long
+    // series of runs, the report covers the replaced samples then. Called after collect_samples().
+    virtual void replace_samples(std::vector<double>) {}
+    // raw samples of the last run for offline analysis, empty if the test case doesn't keep them
+    virtual raw_samples get_raw_samples() const { return {}; }
+};
+
+/*
+ * A test case run by an arbitrary number of workers, every worker is bound to its own CPU core.
+ * The runner guarantees the same as for the two-sided test case: preparation steps of all the
+ * workers are finished before any of them starts the main part. Preparation steps are run
+ * concurrently, so state shared between workers should be set up in set_config().
+ */
+struct multi_test_case_iface {
+    using config = test_case_iface::config;
+
+    virtual ~multi_test_case_iface() = default;
+    virtual void set_config(const config& cfg) = 0;
+    // how many workers (and so CPU cores) the test case needs, valid after set_config()
+    virtual std::size_t workers_count() const noexcept = 0;
+    // preparation step for the specified worker before the main dance begins
+    virtual void prepare(std::size_t worker_idx) = 0;
+    // the main dance of the specified worker
+    virtual void work(std::size_t worker_idx) noexcept = 0;
+    // say what you want to say at the end
+    virtual void report(std::ostream& os) = 0;
+    // latency samples in cycles of the run which the test reports as its main latency, e.g. of
+    // hand-offs through a queue, while the rest of the report stays specific to the test
+    virtual std::vector<double> collect_samples() const = 0;
+};
+
+/*
+ * Gaps between TSC readings in a tight loop of a worker which are longer than a threshold. Such
+ * gaps are caused by interrupts, SMIs or preemption of the worker.
+ */
+struct jitter_log {
+    static constexpr std::size_t s_max_gaps = 4096;
+
+    // what the worker writes, kept in the same kind of mapping as the gaps so it's seen by the
+    // parent when workers are run as processes
+    struct state {
+        std::uint64_t m_last_cycles;
+        std::size_t m_count;
+        // gaps not recorded as the buffer is full
+        std::size_t m_lost;
+    };
+
+    std::uint64_t m_threshold = 0;
+    // start and end cycles of every gap in order of detection
+    sample_buffer<std::pair<std::uint64_t, std::uint64_t>> m_gaps;
+    sample_buffer<state> m_state;
+
+    void prepare(std::uint64_t threshold, const mapping_options& opts) {
+        m_threshold = threshold;
+        allocate_samples(m_gaps, s_max_gaps, opts);
+        allocate_samples(m_state, 1, opts);
+    }
+
+    std::size_t count() const noexcept { return m_state.empty() ? 0 : m_state[0].m_count; }
+    std::size_t lost() const noexcept { return m_state.empty() ? 0 : m_state[0].m_lost; }
+
+    void start(std::uint64_t cycles) noexcept { m_state[0].m_last_cycles = cycles; }
+
+    // account cycles read in the loop
+    void tick(std::uint64_t cycles) noexcept {
+        auto& st = m_state[0];
+        if (cycles - st.m_last_cycles > m_threshold) {
+            if (st.m_count < m_gaps.size())
+                m_gaps[st.m_count++] = {st.m_last_cycles, cycles};
+            else
+                ++st.m_lost;
+        }
+        st.m_last_cycles = cycles;
+    }
 };
 
 /*
@@ -51,26 +161,62 @@ class one_side_test : public test_case_iface {
 protected:
     static constexpr int s_warmup_cycles = 1000;
 
-    std::atomic<std::int8_t> m_continue{0};
     config m_config;
+    // the tested data and the flag synchronizing attempts, each in its own arena slot
+    memory_arena m_arena;
+    std::atomic<std::uint32_t>* m_data = nullptr;
+    std::atomic<std::int8_t>* m_continue = nullptr;
 
     // Store start and end cycles separately by each thread to not get possible cache ping-pong
-    std::vector<std::uint64_t> m_start_cycles;
-    std::vector<std::uint64_t> m_end_cycles;
+    sample_buffer<std::uint64_t> m_start_cycles;
+    sample_buffer<std::uint64_t> m_end_cycles;
 
-    void set_config(const config& cfg) override { m_config = cfg; }
+    // interruptions of the workers detected if it's enabled, samples overlapping them are excluded
+    jitter_log m_one_jitter;
+    jitter_log m_another_jitter;
+
+    // samples and interruptions of all the runs
+    std::vector<double> m_samples;
+    bool m_collected = false;
+    std::size_t m_gaps_detected = 0;
+    std::size_t m_gaps_lost = 0;
+    std::uint64_t m_longest_gap = 0;
+    std::size_t m_interrupted = 0;
+
+    void set_config(const config& cfg) override;
 
     void one_prepare() override {
-        m_start_cycles.resize(m_config.m_attempts_count);
+        // the previous run leaves the flag saying to stop
+        m_data->store(0, std::memory_order_relaxed);
+        m_continue->store(0, std::memory_order_relaxed);
+        m_collected = false;
+        allocate_samples(m_start_cycles, m_config.m_attempts_count, m_config.m_samples_memory);
+        if (m_config.m_jitter_threshold)
+            m_one_jitter.prepare(m_config.m_jitter_threshold, m_config.m_samples_memory);
     }
 
     void another_prepare() override {
-        m_end_cycles.resize(m_config.m_attempts_count);
+        allocate_samples(m_end_cycles, m_config.m_attempts_count, m_config.m_samples_memory);
+        if (m_config.m_jitter_threshold)
+            m_another_jitter.prepare(m_config.m_jitter_threshold, m_config.m_samples_memory);
     }
 
     void one_work() noexcept override;
     void another_work() noexcept override;
     void report(std::ostream& os) override;
+    const std::vector<double>* collect_samples() override;
+    void replace_samples(std::vector<double> samples) override { m_samples = std::move(samples); }
+    raw_samples get_raw_samples() const override {
+        return {sample_dump_header::kind::cycle_pairs, m_start_cycles.data(), m_end_cycles.data(),
+            m_start_cycles.size()};
+    }
+
+private:
+    // the main dance reading TSC in every waiting loop to detect interruptions if requested
+    template <bool DetectJitter>
+    void one_work_impl() noexcept;
+    template <bool DetectJitter>
+    void another_work_impl() noexcept;
 };
 
 /*
@@ -87,13 +233,54 @@ class one_side_asm_test : public one_side_test {
  */
 class one_side_asm_relax_branch_pred_test : public one_side_asm_test {
     static constexpr std::size_t s_samples_size = 10000;
-    std::vector<std::pair<std::uint32_t, std::uint64_t>> m_samples;
+    sample_buffer<std::pair<std::uint32_t, std::uint64_t>> m_samples;
 
     void another_prepare() override {
         one_side_asm_test::another_prepare();
-        m_samples.resize(s_samples_size);
+        allocate_samples(m_samples, s_samples_size, m_config.m_samples_memory);
+    }
+    void another_work() noexcept override;
+};
+
+/*
+ * The same as the one side test but the receiver idles for the configured period before every
+ * attempt, the writer stores the data as soon as the receiver is back to waiting for it. So the
+ * latency is of the first transfer to a core after a quiet period: its caches may be flushed by a
+ * deep C-state, its frequency may be lowered and its predictors are cold.
+ */
+class wake_from_idle_test : public one_side_test {
+    void one_work() noexcept override;
+    void another_work() noexcept override;
+    void report(std::ostream& os) override;
+
+    void idle() const noexcept;
+};
+
+/*
+ * The in-process latency probe (see latency_probe.h) run by two workers doing nothing but calling
+ * it, to compare what it reports with the one side test. The receiver stops the sender after the
+ * configured number of messages.
+ */
+class latency_probe_test : public test_case_iface {
+    // a message per this number of cycles at most
+    static constexpr std::uint64_t s_period_cycles = 10000;
+
+    config m_config;
+    // the probe and the flag stopping the sender, shared with the workers run as processes too
+    memory_arena m_arena;
+    latency_probe* m_probe = nullptr;
+    std::atomic<bool>* m_stop = nullptr;
+
+    void set_config(const config& cfg) override;
+    void one_prepare() override {
+        // the probe of the previous run is replaced, objects in the arena are never destroyed
+        new (m_probe) latency_probe{s_period_cycles};
+        m_stop->store(false, std::memory_order_relaxed);
     }
+    void another_prepare() override {};
+    void one_work() noexcept override;
     void another_work() noexcept override;
+    void report(std::ostream& os) override;
 };
 
 /*
@@ -107,13 +294,309 @@ class ping_pong_test : public test_case_iface {
     static constexpr std::uint32_t s_ping_pongs = 100;
 
     config m_config;
-    std::vector<std::uint64_t> m_cycles;
+    memory_arena m_arena;
+    std::atomic<std::uint32_t>* m_data = nullptr;
+    sample_buffer<std::uint64_t> m_cycles;
+    // samples of all the runs
+    std::vector<double> m_samples;
+    bool m_collected = false;
 
-    void set_config(const config& cfg) override { m_config = cfg; }
-    void one_prepare() override { m_cycles.resize(m_config.m_attempts_count); }
+    void set_config(const config& cfg) override;
+    void one_prepare() override {
+        m_collected = false;
+        allocate_samples(m_cycles, m_config.m_attempts_count, m_config.m_samples_memory);
+    }
     void another_prepare() override {};
     void one_work() noexcept override;
     void another_work() noexcept override;
     void report(std::ostream& os) override;
+    const std::vector<double>* collect_samples() override;
+    void replace_samples(std::vector<double> samples) override { m_samples = std::move(samples); }
+    raw_samples get_raw_samples() const override {
+        return {sample_dump_header::kind::cycles, m_cycles.data(), nullptr, m_cycles.size(), s_ping_pongs};
+    }
 };
 
+/*
+ * N producers and M consumers exchange timestamped items through a shared queue. Workers [0, N)
+ * are producers, the rest ones are consumers, so placement of producers and consumers relative
+ * to each other is defined by the order of CPU ids. Every producer pushes as many items as
+ * attempts configured. A latency sample is a duration between pushing an item and popping it by
+ * a consumer. Throughput is a number of items passed through the queue per second of the whole
+ * exchange.
+ */
+template <template <typename> class Queue>
+class mpmc_queue_test : public multi_test_case_iface {
+    static constexpr std::size_t s_queue_capacity = 1024;
+
+    struct item {
+        // zero value marks an item telling a consumer to stop
+        std::uint64_t m_cycles;
+        std::size_t m_producer;
+    };
+
+    using queue_t = Queue<item>;
+
+    // every worker writes only its own data
+    struct alignas(g_cache_line_size) worker_data {
+        sample_buffer<std::uint64_t> m_latencies;
+        std::size_t m_count = 0;
+        std::uint64_t m_first_cycles = 0;
+        std::uint64_t m_last_cycles = 0;
+        // nodes of a list queue owned by a producer
+        std::unique_ptr<typename list_mpmc_queue<item>::node[]> m_nodes;
+        std::size_t m_next_node = 0;
+    };
+
+    config m_config;
+    std::unique_ptr<queue_t> m_queue;
+    std::vector<worker_data> m_workers;
+    alignas(g_cache_line_size) std::atomic<std::uint32_t> m_producers_done{0};
+
+    void set_config(const config& cfg) override;
+    std::size_t workers_count() const noexcept override {
+        return m_config.m_producers + m_config.m_consumers;
+    }
+    void prepare(std::size_t worker_idx) override;
+    void work(std::size_t worker_idx) noexcept override;
+    void report(std::ostream& os) override;
+    std::vector<double> collect_samples() const override;
+
+    void produce(worker_data& data, const item& it) noexcept;
+};
+
+using mpmc_array_queue_test = mpmc_queue_test<bounded_mpmc_queue>;
+using mpmc_list_queue_test = mpmc_queue_test<list_mpmc_queue>;
+
+/*
+ * One writer (worker 0) updates a record of several cache lines under a sequence counter while
+ * the rest workers read it retrying when the record was changed during reading (seqlock). The
+ * test measures duration of a record update by the writer and duration of a successful read
+ * including all the retries by a reader, and how often readers have to retry.
+ */
+class seqlock_test : public multi_test_case_iface {
+    static constexpr std::size_t s_words_per_line = g_cache_line_size / sizeof(std::uint64_t);
+    // pause between updates to let readers read the record without interference
+    static constexpr int s_pause_cycles = 1000;
+    // readers are expected to read a record several times per every update
+    static constexpr std::size_t s_reads_per_update = 4;
+
+    struct alignas(g_cache_line_size) record_line {
+        std::atomic<std::uint64_t> m_words[s_words_per_line];
+    };
+
+    // every reader writes only its own data
+    struct alignas(g_cache_line_size) reader_data {
+        // a uniform random subset of latencies of all the reads, see work()
+        sample_buffer<std::uint64_t> m_latencies;
+        std::size_t m_count = 0;
+        std::uint64_t m_reads = 0;
+        // reads discarded as the record was changed while it was read
+        std::uint64_t m_retries = 0;
+        // reads which started while the writer was updating the record
+        std::uint64_t m_waits = 0;
+    };
+
+    config m_config;
+    // the sequence and the record, each in their own arena slots
+    memory_arena m_arena;
+    std::atomic<std::uint64_t>* m_sequence = nullptr;
+    record_line* m_record = nullptr;
+    alignas(g_cache_line_size) std::atomic<bool> m_stop{false};
+    sample_buffer<std::uint64_t> m_update_cycles;
+    std::vector<reader_data> m_readers;
+
+    void set_config(const config& cfg) override;
+    std::size_t workers_count() const noexcept override { return 1 + m_config.m_readers; }
+    void prepare(std::size_t worker_idx) override;
+    void work(std::size_t worker_idx) noexcept override;
+    void report(std::ostream& os) override;
+    std::vector<double> collect_samples() const override;
+};
+
+/*
+ * A single writer (worker 0) publishes timestamped events into a ring which is read by the rest
+ * workers, every one of them sees all the events and tracks its own cursor (like LMAX Disruptor
+ * does). Before publishing the writer reads cursors of all the consumers to not overrun the
+ * slowest one. The test measures latency between publishing an event and reading it for every
+ * consumer, and how long the writer spends on reading consumers cursors.
+ */
+class broadcast_ring_test : public multi_test_case_iface {
+    static constexpr std::size_t s_ring_size = 1024;
+    // pause between events to measure hand-off latency rather than queueing in the ring
+    static constexpr int s_pause_cycles = 1000;
+
+    struct alignas(g_cache_line_size) slot {
+        std::uint64_t m_cycles;
+    };
+
+    struct alignas(g_cache_line_size) cursor {
+        std::atomic<std::uint64_t> m_value{0};
+    };
+
+    // every consumer writes only its own data
+    struct alignas(g_cache_line_size) consumer_data {
+        sample_buffer<std::uint64_t> m_latencies;
+    };
+
+    config m_config;
+    // the published counter, the ring and every cursor, each in their own arena slots
+    memory_arena m_arena;
+    std::atomic<std::uint64_t>* m_published = nullptr;
+    slot* m_ring = nullptr;
+    std::vector<cursor*> m_cursors;
+    std::vector<consumer_data> m_consumers;
+    sample_buffer<std::uint64_t> m_gating_cycles;
+    // events which had to wait for the slowest consumer before being published
+    std::uint64_t m_gating_stalls = 0;
+
+    void set_config(const config& cfg) override;
+    std::size_t workers_count() const noexcept override { return 1 + m_config.m_consumers; }
+    void prepare(std::size_t worker_idx) override;
+    void work(std::size_t worker_idx) noexcept override;
+    void report(std::ostream& os) override;
+    std::vector<double> collect_samples() const override;
+};
+
+enum class counter_sharding {
+    // all the workers increment a single atomic counter
+    none,
+    // every worker increments its own counter placed in its own cache line
+    per_core,
+    // workers running on the same NUMA node increment a counter of the node
+    per_numa_node
+};
+
+/*
+ * Workers starting from the second one increment a shared counter as fast as they can while the
+ * first worker periodically reads its value summing all the shards. The test measures increments
+ * throughput and duration of reading the counter value depending on how the counter is sharded.
+ */
+template <counter_sharding Sharding>
+class sharded_counter_test : public multi_test_case_iface {
+    // pause between reads of the counter value
+    static constexpr int s_read_period_cycles = 10000;
+
+    struct alignas(g_cache_line_size) shard {
+        std::atomic<std::uint64_t> m_value{0};
+    };
+
+    // every incrementer writes only its own data
+    struct alignas(g_cache_line_size) incrementer_data {
+        shard* m_shard = nullptr;
+        std::uint64_t m_increments = 0;
+        std::uint64_t m_start_cycles = 0;
+        std::uint64_t m_end_cycles = 0;
+    };
+
+    config m_config;
+    alignas(g_cache_line_size) std::atomic<bool> m_stop{false};
+    // a single arena or, for per-node shards, an arena on every node so a shard is placed on the
+    // node of its incrementers
+    std::vector<memory_arena> m_arenas;
+    std::vector<shard*> m_shards;
+    // NUMA node of every per-node shard, negative if the shard isn't bound to a node
+    std::vector<int> m_shard_nodes;
+    std::size_t m_shards_count = 0;
+    std::vector<incrementer_data> m_incrementers;
+    sample_buffer<std::uint64_t> m_read_cycles;
+
+    void set_config(const config& cfg) override;
+    std::size_t workers_count() const noexcept override { return 1 + m_config.m_incrementers; }
+    void prepare(std::size_t worker_idx) override;
+    void work(std::size_t worker_idx) noexcept override;
+    void report(std::ostream& os) override;
+    std::vector<double> collect_samples() const override;
+};
+
+using global_counter_test = sharded_counter_test<counter_sharding::none>;
+using per_core_counter_test = sharded_counter_test<counter_sharding::per_core>;
+using per_numa_node_counter_test = sharded_counter_test<counter_sharding::per_numa_node>;
+
+/*
+ * Runs the one side and the ping pong hand-offs with the data stored using different memory
+ * orderings (relaxed, release/acquire, seq_cst) and with relaxed stores followed by explicit
+ * fences (mfence, sfence, a locked instruction), and reports how much every variant adds to the
+ * relaxed one.
+ */
+class memory_ordering_test : public test_case_iface {
+    static constexpr int s_variants = 6;
+    static constexpr int s_warmup_cycles = 1000;
+    static constexpr std::uint32_t s_ping_pongs = 100;
+    // one side samples never match values left by the ping pong
+    static constexpr std::uint32_t s_first_sample = 1 << 16;
+
+    config m_config;
+    memory_arena m_arena;
+    std::atomic<std::uint32_t>* m_data = nullptr;
+    std::atomic<std::int8_t>* m_continue = nullptr;
+    // samples of all the variants one by one
+    sample_buffer<std::uint64_t> m_start_cycles;
+    sample_buffer<std::uint64_t> m_end_cycles;
+    sample_buffer<std::uint64_t> m_ping_pong_cycles;
+
+    void set_config(const config& cfg) override;
+
+    void one_prepare() override {
+        allocate_samples(m_start_cycles,
+            std::size_t{m_config.m_attempts_count} * s_variants, m_config.m_samples_memory);
+        allocate_samples(m_ping_pong_cycles,
+            std::size_t{m_config.m_attempts_count} * s_variants, m_config.m_samples_memory);
+    }
+
+    void another_prepare() override {
+        allocate_samples(m_end_cycles,
+            std::size_t{m_config.m_attempts_count} * s_variants, m_config.m_samples_memory);
+    }
+
+    void one_work() noexcept override;
+    void another_work() noexcept override;
+    void report(std::ostream& os) override;
+
+    template <int Variant>
+    void one_work_variant(std::uint32_t& data_sample) noexcept;
+    template <int Variant>
+    void another_work_variant(std::uint32_t& data_sample) noexcept;
+};
+
+/*
+ * The same as the one side test but the writer executes a fence right after the store (mfence,
+ * sfence, a locked instruction or the store is made by xchg) and takes one more timestamp when
+ * the fence is completed locally. The test reports both how long the store takes to become
+ * visible to the other core and the local cost of the store with the fence, which separates
+ * draining of the store buffer from the cache coherence latency.
+ */
+class store_fence_test : public test_case_iface {
+    static constexpr int s_variants = 5;
+    static constexpr int s_warmup_cycles = 1000;
+
+    config m_config;
+    memory_arena m_arena;
+    std::atomic<std::uint32_t>* m_data = nullptr;
+    std::atomic<std::int8_t>* m_continue = nullptr;
+    // samples of all the variants one by one
+    sample_buffer<std::uint64_t> m_start_cycles;
+    sample_buffer<std::uint64_t> m_fenced_cycles;
+    sample_buffer<std::uint64_t> m_end_cycles;
+
+    void set_config(const config& cfg) override;
+
+    void one_prepare() override {
+        allocate_samples(m_start_cycles,
+            std::size_t{m_config.m_attempts_count} * s_variants, m_config.m_samples_memory);
+        allocate_samples(m_fenced_cycles,
+            std::size_t{m_config.m_attempts_count} * s_variants, m_config.m_samples_memory);
+    }
+
+    void another_prepare() override {
+        allocate_samples(m_end_cycles,
+            std::size_t{m_config.m_attempts_count} * s_variants, m_config.m_samples_memory);
+    }
+
+    void one_work() noexcept override;
+    void another_work() noexcept override;
+    void report(std::ostream& os) override;
+
+    template <int Variant>
+    void one_work_variant(std::uint32_t& data_sample) noexcept;
+};
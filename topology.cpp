@@ -0,0 +1,151 @@
+// vim: textwidth=100
+#include "topology.h"
+
+#include <cstdlib>
+#include <cstring>
+#include <algorithm>
+#include <string>
+#include <fstream>
+#include <tuple>
+#include <sstream>
+#include <stdexcept>
+
+#include <dirent.h>
+
+namespace {
+
+int read_int(const std::string& path) {
+    std::ifstream is{path};
+    int res;
+    if (! (is >> res))
+        return -1;
+    return res;
+}
+
+std::string cpu_sysfs_path(unsigned cpuid) {
+    return "/sys/devices/system/cpu/cpu" + std::to_string(cpuid);
+}
+
+} // ns anonymous
+
+int cpu_package_id(unsigned cpuid) {
+    return read_int(cpu_sysfs_path(cpuid) + "/topology/physical_package_id");
+}
+
+int cpu_core_id(unsigned cpuid) {
+    return read_int(cpu_sysfs_path(cpuid) + "/topology/core_id");
+}
+
+int cpu_numa_node(unsigned cpuid) {
+    // the node a CPU belongs to is exposed as a "nodeN" link in the CPU's directory
+    int res = -1;
+    if (auto dir = opendir(cpu_sysfs_path(cpuid).c_str())) {
+        while (auto entry = readdir(dir)) {
+            char* end;
+            if (std::strncmp(entry->d_name, "node", 4) != 0)
+                continue;
+            if (auto node = std::strtol(entry->d_name + 4, &end, 10); end != entry->d_name + 4 && *end == '\0') {
+                res = static_cast<int>(node);
+                break;
+            }
+        }
+        closedir(dir);
+    }
+    return res;
+}
+
+int cpu_cache_id(unsigned cpuid, unsigned level) {
+    // caches of a CPU are exposed as "indexN" directories, the first one of the level is taken as
+    // L1 instruction and data caches are shared by the same CPUs
+    const auto cache_path = cpu_sysfs_path(cpuid) + "/cache/index";
+    for (unsigned idx = 0; ; ++idx) {
+        const auto index_level = read_int(cache_path + std::to_string(idx) + "/level");
+        if (index_level < 0)
+            return -1;
+        if (static_cast<unsigned>(index_level) == level)
+            return read_int(cache_path + std::to_string(idx) + "/id");
+    }
+}
+
+void sort_by_topology(std::vector<unsigned short>& cpuids) {
+    // CPUs are grouped by the deepest cache level which is known for all of them
+    unsigned llc_level = 0;
+    for (unsigned level = 3; level > 0 && llc_level == 0; --level)
+        if (std::all_of(cpuids.begin(), cpuids.end(), [level](auto cpuid){ return cpu_cache_id(cpuid, level) >= 0; }))
+            llc_level = level;
+
+    std::vector<std::tuple<int, int, int, unsigned short>> keys;
+    for (auto cpuid : cpuids)
+        keys.emplace_back(cpu_package_id(cpuid), llc_level ? cpu_cache_id(cpuid, llc_level) : -1,
+            cpu_core_id(cpuid), cpuid);
+    std::sort(keys.begin(), keys.end());
+
+    for (std::size_t idx = 0; idx < keys.size(); ++idx)
+        cpuids[idx] = std::get<3>(keys[idx]);
+}
+
+std::vector<unsigned> numa_memory_nodes() {
+    // "possible" and "online" may list memoryless nodes, memory can't be bound to them
+    for (auto list_path : {"/sys/devices/system/node/has_memory", "/sys/devices/system/node/online"}) {
+        std::ifstream is{list_path};
+        std::string list;
+        if (! std::getline(is, list))
+            continue;
+        try {
+            return parse_cpu_list(list);
+        } catch (const std::invalid_argument&) {
+            return {};
+        }
+    }
+    return {};
+}
+
+int numa_distance(unsigned from, unsigned to) {
+    // the distances to the online nodes in order of their ids
+    std::ifstream online_is{"/sys/devices/system/node/online"};
+    std::string list;
+    if (! std::getline(online_is, list))
+        return -1;
+    std::vector<unsigned> online;
+    try {
+        online = parse_cpu_list(list);
+    } catch (const std::invalid_argument&) {
+        return -1;
+    }
+    const auto pos = std::find(online.begin(), online.end(), to);
+    if (pos == online.end())
+        return -1;
+
+    std::ifstream is{"/sys/devices/system/node/node" + std::to_string(from) + "/distance"};
+    int res = -1;
+    for (auto it = online.begin(); it <= pos; ++it)
+        if (! (is >> res))
+            return -1;
+    return res;
+}
+
+std::vector<unsigned> parse_cpu_list(std::string_view list) {
+    std::vector<unsigned> res;
+
+    while (! list.empty() && (list.back() == '\n' || list.back() == ' '))
+        list.remove_suffix(1);
+
+    std::istringstream is{std::string{list}};
+    std::string range;
+    while (std::getline(is, range, ',')) {
+        unsigned first, last;
+        char dash;
+        std::istringstream range_is{range};
+        if (! (range_is >> first))
+            throw std::invalid_argument{"bad cpu list item \"" + range + "\""};
+        last = first;
+        if (range_is >> dash && (dash != '-' || ! (range_is >> last) || last < first))
+            throw std::invalid_argument{"bad cpu list item \"" + range + "\""};
+        if (! range_is.eof())
+            throw std::invalid_argument{"bad cpu list item \"" + range + "\""};
+        for (auto cpuid = first; cpuid <= last; ++cpuid)
+            res.push_back(cpuid);
+    }
+
+    return res;
+}
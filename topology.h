@@ -0,0 +1,29 @@
+// vim: textwidth=100
+#pragma once
+
+#include <string_view>
+#include <vector>
+
+/*
+ * CPU topology as it's exposed by the kernel via sysfs. Every getter returns -1 if the
+ * information isn't available (e.g. the system isn't Linux or sysfs isn't mounted).
+ */
+
+int cpu_package_id(unsigned cpuid);
+int cpu_core_id(unsigned cpuid);
+int cpu_numa_node(unsigned cpuid);
+// id of the cache of the level (e.g. 3 for LLC on most of x86 CPUs) the CPU uses
+int cpu_cache_id(unsigned cpuid, unsigned level);
+
+// order CPUs by package, last level cache, core and id, so SMT siblings are neighbours and CPUs
+// sharing a cache are grouped together
+void sort_by_topology(std::vector<unsigned short>& cpuids);
+
+// online NUMA nodes having memory in ascending order, empty if it isn't known
+std::vector<unsigned> numa_memory_nodes();
+
+// relative distance between NUMA nodes as the firmware reports it (10 for the node itself)
+int numa_distance(unsigned from, unsigned to);
+
+// parse a list in the kernel format like "0-3,8,10-11"; throws std::invalid_argument on errors
+std::vector<unsigned> parse_cpu_list(std::string_view list);
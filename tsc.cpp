@@ -0,0 +1,61 @@
+// vim: textwidth=100
+#include "tsc.h"
+
+#include <cmath>
+#include <chrono>
+
+namespace {
+
+double measure_cpu_freq_ghz() {
+    using fp_seconds_t = 
+        std::chrono::duration<double, std::chrono::seconds::period>;
+
+    auto get_freq_hz = [](){
+        auto time_pt = std::chrono::high_resolution_clock::now();
+        std::uint64_t end_ts, start_ts = rdtsc();
+        do {
+            end_ts = rdtsc();
+        } while (end_ts - start_ts < 1'000'000);
+        return (end_ts - start_ts) /
+            fp_seconds_t(std::chrono::high_resolution_clock::now() - time_pt).count();
+    };
+
+    double freq_prev, freq = get_freq_hz();
+    do {
+        freq_prev = freq;
+        freq = get_freq_hz();
+    } while (std::abs(freq - freq_prev) > 1000.0);
+
+    return freq / 1'000'000'000.0;
+}
+
+} // ns anonymous
+
+double get_cpu_freq_ghz() {
+    // the rate is invariant, so it's measured once as converging readings take a while
+    static const double res = measure_cpu_freq_ghz();
+    return res;
+}
+
+double core_to_tsc_ratio() {
+    constexpr std::uint64_t loops = 10000;
+    // the number of additions in the asm block below
+    constexpr std::uint64_t additions = 100;
+
+    double res = 0.0;
+    // the first measurement lets the core leave a power saving state
+    for (int attempt = 0; attempt < 2; ++attempt) {
+        std::uint64_t value = 0, step = 1;
+        const auto start = rdtsc_ordered();
+        // additions of an immediate could be folded by the register renaming of recent CPUs
+        for (std::uint64_t i = 0; i < loops; ++i)
+            asm volatile (".rept 100\n"
+                          "add %1, %0\n"
+                          ".endr\n"
+                          : "+r" (value)
+                          : "r" (step));
+        const auto end = rdtsc_ordered();
+        res = static_cast<double>(loops * additions) / static_cast<double>(end - start);
+    }
+    return res;
+}
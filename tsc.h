@@ -0,0 +1,40 @@
+// vim: textwidth=100
+#pragma once
+
+#include <cstdint>
+
+/*
+ * Reading of the time stamp counter. The counter is expected to be invariant, i.e. it runs at
+ * a constant rate regardless of the core frequency and C-states, and synchronized between cores.
+ */
+
+inline std::uint64_t rdtsc() {
+    std::uint64_t res;
+    asm volatile ("rdtsc\n"
+                  "shl $32, %%rdx\n"
+                  "or %%rdx, %0\n"
+                  : "=a" (res)
+                  :
+                  : "cc", "rdx");
+    return res;
+}
+
+// the timestamp is taken only after all the previous instructions are completed locally
+inline std::uint64_t rdtsc_ordered() {
+    std::uint64_t res;
+    asm volatile ("lfence\n"
+                  "rdtsc\n"
+                  "shl $32, %%rdx\n"
+                  "or %%rdx, %0\n"
+                  : "=a" (res)
+                  :
+                  : "cc", "rdx", "memory");
+    return res;
+}
+
+// the rate of the time stamp counter measured against the system clock once per process
+double get_cpu_freq_ghz();
+
+// how many core cycles pass per TSC cycle on the calling CPU, i.e. the current core frequency
+// relative to the TSC rate; measured by a chain of dependent additions taking a cycle each
+double core_to_tsc_ratio();